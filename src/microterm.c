@@ -22,9 +22,24 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <strings.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
+#include <fcntl.h>
 #include <vte/vte.h>
 #include <ctype.h>
+#include <errno.h>
 #include <glib.h>
+#include <glib-unix.h>
+#define PCRE2_CODE_UNIT_WIDTH 0
+#include <pcre2.h>
+#include <glib/gstdio.h>
+#include <gio/gunixsocketaddress.h>
+
+/* vte_terminal_get_text_selected, copy on selection */
+#if !VTE_CHECK_VERSION(0, 70, 0)
+#error "VTE 0.70 or later is required"
+#endif
 
 #define UNUSED(x) (void)(x)
 #define CLR_R(x) (((x)&0xff0000) >> 16)
@@ -44,9 +59,15 @@ static GtkWidget* current_terminal; // Current focues terminal
 static GtkWidget* commander; // Command prompt
 
 /* Fonts */
-static PangoFontDescription* font_desc;
 static char* font_size;
-static int current_font_size; // required for font inc and dec function
+static gboolean zoom_window = FALSE; /* Font zoom applies to every terminal of the window */
+static GtkWidget* zoom_target; /* Terminal or window of the pending zoom */
+static int zoom_size; /* Font size of the pending zoom */
+static guint zoom_source; /* Pending zoom timeout */
+
+/* Interactive resize */
+static GQueue resizing_terminals = G_QUEUE_INIT; /* Terminals with rewrap deferred until the resize settles */
+static guint resize_source; /* Resize settle timeout or rewrap idle */
 
 /* Set default values */
 static float term_opacity = TERM_OPACITY;
@@ -65,56 +86,739 @@ static int tab_position = 0;
 static int commander_position = 1;
 static gboolean focus_follow_mouse = FALSE;
 static gboolean copy_on_selection = TRUE;
+static gboolean rewrap_on_resize = TRUE;
+static gboolean watch_config = FALSE; /* Reload when configuration files change */
+static char* log_dir; /* Directory of the pane logs, NULL disable the log */
+static int log_max_mb = 0; /* Log size before rotation, 0 never rotate */
+static gboolean log_compress = FALSE; /* Compress rotated logs */
+static gboolean log_all = FALSE; /* Log every new terminal */
+static int hibernate_after = 0; /* Seconds before a hidden tab releases its rendering resources, 0 never */
 static gboolean default_config_file = TRUE;
 static gboolean debug_mode = FALSE; /* Print debug messages */
+static gboolean server_mode = FALSE; /* Stay resident and open windows on client request */
+static gboolean open_in_tab = FALSE; /* Client asks for a new tab instead of a new window */
+static gboolean restore_mode = FALSE; /* Restore the saved session in the first window */
+static gboolean restoring_session = FALSE; /* Session restore in progress */
+static gboolean latency_mode = FALSE; /* Measure keystroke to screen latency */
+static int profile_mode = PROFILE_OFF; /* Startup profiler output */
+static int sync_input = SCOPE_CURRENT; /* Terminals that receive the typed keys */
+static gboolean broadcasting = FALSE; /* Text sent by the program, commit must not repeat it */
+static int pool_size = 0; /* Number of pre-spawned terminals kept ready, 0 disable the pool */
+static long scrollback_lines = TERM_SCROLLBACK_LINES; /* Scrollback lines per terminal, -1 for unlimited */
+static int scrollback_budget_mb = 0; /* Scrollback memory shared by all terminals, 0 for no budget */
 
 /* Runtimes */
+static RenderSettings* render_settings; /* Current configuration render settings */
 static int color_count = 0;
 static char* term_title;
 static char* word_chars;
+static char* font_value; /* Allocated term_font read from configuration */
+static char* locale_value; /* Allocated term_locale read from configuration */
 static char* working_dir; /* Working directory */
 static char* term_command; /* When use -e this value will be populated with passed command */
-static gchar **envp;
-static gchar **command;
 
 static char* config_file_name; /* Configuration file name */
-static GHashTable* hotkeys; /* Hotkey bindings */
-static va_list vargs;
+static GPtrArray* config_files; /* Configuration and included files */
+static GList* config_monitors; /* File monitors of configuration files */
+static guint config_reload_id; /* Pending automatic reload */
+static GHashTable* hotkeys; /* Compiled hotkey bindings, hotkey code -> Binding */
+static GHashTable* chord; /* Pending chord, next keys table or NULL */
+static GSocketService* server; /* Window server, only in server mode */
+static char* socket_path; /* Path of the server unix socket */
+static char* control_socket; /* Control socket from configuration, NULL disabled */
+static GSocketService* control_server; /* Control socket service */
+static char* control_path; /* Path of the control unix socket */
+static char* latency_file; /* Latency report written on exit, stderr if NULL */
+static LatencyStats latency_closed; /* Latency of closed terminals */
+static gint64 profile_start; /* Monotonic time at main start */
+static ProfileMark profile_marks[PROFILE_MAX_MARKS]; /* Startup phases */
+static int profile_count;
+static GQueue* terminal_pool; /* Pre-spawned terminals ready for new_tab and split */
+static GtkWidget* pool_box; /* Hidden container that holds the pooled terminals */
+static guint pool_refill_id; /* Idle source that refills the pool */
+static char* pool_dir; /* Working directory of the pooled shells */
+static guint scrollback_check_id; /* Timeout source that enforces the scrollback budget */
+static Search* search_all; /* Search across all panes in progress */
+static GThread* log_thread; /* Writer of the pane logs */
+static GAsyncQueue* log_queue; /* New loggers for the writer thread */
+static Logger log_stop; /* Queued to stop the writer thread */
+static guint stats_wakeups; /* Main loop wakeups */
+static StatsBaseline stats_baselines[STATS_CONSUMERS]; /* Previous stats report of each consumer */
+static GHashTable* panes; /* Pane registry, terminal -> Pane */
+static GHashTable* panes_by_id; /* Pane registry, id -> Pane */
+static GQueue pane_mru = G_QUEUE_INIT; /* Panes, most recently focused first */
+static guint pane_next_id = 1;
+static TraceEvent trace_ring[TRACE_RING_SIZE]; /* Last trace events */
+static gint trace_next; /* Trace events recorded, next slot */
+static gboolean trace_enabled = TRUE; /* Record trace events in the ring */
+static const char* trace_levels[] = { "severe", "error", "warning", "info", "trace" };
+
+
+/*!
+ * Parse a printf conversion specification.
+ * The specification is normalized for trace_format: length modifiers are
+ * dropped and integers are always printed as long long.
+ *
+ * \param format pointer to '%'
+ * \param spec normalized specification, TRACE_SPEC_SIZE bytes
+ * \param type argument type: 'i' int, 'l' long, 'L' long long, 'u' unsigned,
+ *             'U' unsigned long, 'Q' unsigned long long, 'f' double,
+ *             's' string, 'p' pointer, 0 for "%%" or unsupported
+ * \param stars int arguments taken by '*' width and precision, before the value
+ * \return pointer after the specification
+ */
+static const char* trace_parse_spec(const char *format, char *spec, char *type, int *stars) {
+    const char *f = format + 1;
+    int longs = 0;
+    gsize length = 1;
+    spec[0] = '%';
+    *type = 0;
+    *stars = 0;
+    while (*f != '\0' && strchr("-+ #0123456789.*", *f) != NULL) {
+        if (*f == '*') (*stars)++;
+        if (length < TRACE_SPEC_SIZE - 4) spec[length++] = *f;
+        f++;
+    }
+    while (*f != '\0' && strchr("hlLqjzt", *f) != NULL) {
+        longs += *f == 'l' ? 1 : (*f == 'h' ? 0 : 2);
+        f++;
+    }
+    if (*f == '\0') return f;
+    char conversion = *f++;
+    if (strchr("dic", conversion) != NULL) {
+        *type = longs == 0 ? 'i' : (longs == 1 ? 'l' : 'L');
+        if (conversion != 'c') {
+            spec[length++] = 'l';
+            spec[length++] = 'l';
+        }
+    } else if (strchr("ouxX", conversion) != NULL) {
+        /* Unsigned values are zero extended, not sign extended */
+        *type = longs == 0 ? 'u' : (longs == 1 ? 'U' : 'Q');
+        spec[length++] = 'l';
+        spec[length++] = 'l';
+    } else if (strchr("fFeEgGaA", conversion) != NULL) {
+        *type = 'f';
+    } else if (conversion == 's' || conversion == 'p') {
+        *type = conversion;
+    }
+    spec[length++] = conversion;
+    spec[length] = '\0';
+    return f;
+}
+
+/*!
+ * Record a trace event in the ring: time, level, format and the raw
+ * arguments, strings copied. Formatting is deferred to the dump.
+ * The '*' width and precision are recorded as values before their argument,
+ * strings are copied up to their precision.
+ *
+ * \param level LEVEL_* value
+ * \param format format string literal
+ * \param args format arguments
+ */
+static void trace_record(int level, const char *format, va_list args) {
+    TraceEvent *event = &trace_ring[(guint)g_atomic_int_add(&trace_next, 1) & (TRACE_RING_SIZE - 1)];
+    char spec[TRACE_SPEC_SIZE], type;
+    int stars;
+    gsize size = 0;
+    event->time = g_get_monotonic_time();
+    event->format = format;
+    event->level = level;
+    for (const char *f = strchr(format, '%'); f != NULL; f = strchr(f, '%')) {
+        f = trace_parse_spec(f, spec, &type, &stars);
+        int star = 0;
+        for (int i = 0; i < stars; i++) {
+            gint64 value = star = va_arg(args, int);
+            if (size + sizeof(value) > TRACE_PAYLOAD_SIZE) break;
+            memcpy(event->payload + size, &value, sizeof(value));
+            size += sizeof(value);
+        }
+        if (type == 's') {
+            const char *value = va_arg(args, const char*);
+            if (value == NULL) value = "(null)";
+            if (size >= TRACE_PAYLOAD_SIZE) break;
+            /* Precision, the string may not be terminated after it */
+            const char *dot = strchr(spec, '.');
+            long precision = dot == NULL ? -1 : (dot[1] == '*' ? star : atol(dot + 1));
+            gsize length = precision >= 0 ? strnlen(value, precision) : strlen(value);
+            length = MIN(length, TRACE_PAYLOAD_SIZE - size - 1);
+            memcpy(event->payload + size, value, length);
+            event->payload[size + length] = '\0';
+            size += length + 1;
+        } else if (type != 0) {
+            gint64 value = 0;
+            double real;
+            switch (type) {
+                case 'i': value = va_arg(args, int); break;
+                case 'l': value = va_arg(args, long); break;
+                case 'L': value = va_arg(args, long long); break;
+                case 'u': value = va_arg(args, unsigned int); break;
+                case 'U': value = va_arg(args, unsigned long); break;
+                case 'Q': value = (gint64)va_arg(args, unsigned long long); break;
+                case 'p': value = (gint64)(gintptr)va_arg(args, void*); break;
+                case 'f':
+                    real = va_arg(args, double);
+                    memcpy(&value, &real, sizeof(value));
+                    break;
+            }
+            if (size + sizeof(value) > TRACE_PAYLOAD_SIZE) break;
+            memcpy(event->payload + size, &value, sizeof(value));
+            size += sizeof(value);
+        }
+    }
+    event->size = size;
+}
+
+/*!
+ * Format a recorded trace event, without allocations so it can be used
+ * by the crash handler.
+ *
+ * \param event
+ * \param buffer output buffer
+ * \param buffer_size
+ * \return formatted length
+ */
+static gsize trace_format(TraceEvent *event, char *buffer, gsize buffer_size) {
+    char spec[TRACE_SPEC_SIZE], resolved[TRACE_SPEC_SIZE * 4], type;
+    int stars;
+    gsize used = snprintf(buffer, buffer_size, "%12.6f [ %s ] ", (event->time - profile_start) / (double)G_USEC_PER_SEC, trace_levels[event->level]);
+    gsize offset = 0;
+    const char *f = event->format;
+    while (*f != '\0' && used < buffer_size - 2) {
+        if (*f != '%') {
+            buffer[used++] = *f++;
+            continue;
+        }
+        if (f[1] == '%') {
+            buffer[used++] = '%';
+            f += 2;
+            continue;
+        }
+        f = trace_parse_spec(f, spec, &type, &stars);
+        gint64 value = 0;
+        double real;
+        /* Replace the '*' width and precision with their recorded values */
+        gsize length = 0;
+        for (const char *c = spec; *c != '\0' && stars >= 0; c++) {
+            if (*c != '*') {
+                resolved[length++] = *c;
+                continue;
+            }
+            if (event->size - offset < sizeof(value)) {
+                stars = -1;
+                break;
+            }
+            memcpy(&value, event->payload + offset, sizeof(value));
+            offset += sizeof(value);
+            length += snprintf(resolved + length, sizeof(resolved) - length, "%d", (int)value);
+        }
+        resolved[length] = '\0';
+        if (stars < 0) {
+            used += snprintf(buffer + used, buffer_size - used, "...");
+            break;
+        }
+        if (type == 0) continue;
+        gsize left = event->size - offset;
+        if (type == 's' ? left == 0 : left < sizeof(value)) {
+            /* Arguments truncated when recorded */
+            used += snprintf(buffer + used, buffer_size - used, "...");
+            break;
+        }
+        if (type == 's') {
+            used += snprintf(buffer + used, buffer_size - used, resolved, event->payload + offset);
+            offset += strlen(event->payload + offset) + 1;
+        } else {
+            memcpy(&value, event->payload + offset, sizeof(value));
+            offset += sizeof(value);
+            if (type == 'f') {
+                memcpy(&real, &value, sizeof(real));
+                used += snprintf(buffer + used, buffer_size - used, resolved, real);
+            } else if (type == 'p') {
+                used += snprintf(buffer + used, buffer_size - used, resolved, (void*)(gintptr)value);
+            } else if (resolved[length - 1] == 'c') {
+                used += snprintf(buffer + used, buffer_size - used, resolved, (int)value);
+            } else {
+                used += snprintf(buffer + used, buffer_size - used, resolved, (long long)value);
+            }
+        }
+    }
+    used = MIN(used, buffer_size - 2);
+    buffer[used++] = '\n';
+    buffer[used] = '\0';
+    return used;
+}
+
+/*!
+ * Write the recorded trace events to a file descriptor, oldest first.
+ * Only write(2) and snprintf are used, so it can run in the crash handler.
+ *
+ * \param fd output file descriptor
+ */
+static void trace_dump(int fd) {
+    char line[TRACE_LINE_SIZE];
+    guint next = (guint)g_atomic_int_get(&trace_next);
+    guint count = MIN(next, TRACE_RING_SIZE);
+    for (guint i = next - count; i != next; i++) {
+        gsize length = trace_format(&trace_ring[i & (TRACE_RING_SIZE - 1)], line, sizeof(line));
+        if (write(fd, line, length) < 0) break;
+    }
+}
+
+/*!
+ * Dump the trace events to a file.
+ *
+ * \param path output file, NULL for $XDG_RUNTIME_DIR/microterm-trace-<pid>.log
+ * \return dump file, free with g_free, NULL on error
+ */
+static char* trace_dump_file(const char *path) {
+    char *file = path != NULL ? g_strdup(path) : g_strdup_printf("%s/%s-trace-%d.log", g_get_user_runtime_dir(), APP_NAME, getpid());
+    int fd = g_open(file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        print_line(LEVEL_ERROR,"Unable to write trace %s", file);
+        g_free(file);
+        return NULL;
+    }
+    trace_dump(fd);
+    g_close(fd, NULL);
+    return file;
+}
+
+/*!
+ * SIGUSR2 handler, dump the trace events to the default file.
+ *
+ * \param user_data
+ * \return G_SOURCE_CONTINUE
+ */
+static gboolean on_trace_signal(gpointer user_data) {
+    UNUSED(user_data);
+    char *file = trace_dump_file(NULL);
+    print_line(LEVEL_INFO,"Trace written to %s", file);
+    g_free(file);
+    return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * Fatal signal handler, print the last trace events to stderr then let
+ * the default action run.
+ *
+ * \param signum
+ */
+static void on_crash(int signum) {
+    static const char header[] = "µterm crashed, last trace events:\n";
+    if (write(STDERR_FILENO, header, sizeof(header) - 1) >= 0) trace_dump(STDERR_FILENO);
+    signal(signum, SIG_DFL);
+    raise(signum);
+}
+
+/*!
+ * Install the trace dump handlers: SIGUSR2 and fatal signals.
+ */
+static void start_trace() {
+    int fatal[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    for (gsize i = 0; i < G_N_ELEMENTS(fatal); i++) signal(fatal[i], on_crash);
+    g_unix_signal_add(SIGUSR2, on_trace_signal, NULL);
+}
 
+/*!
+ * Function for control the trace ring.
+ *
+ * \param argument dump [path], on or off
+ * \return TRUE if valid argument
+ */
+static gboolean set_trace(char* argument) {
+    if (argument == NULL) return FALSE;
+    if (strcmp(argument, "on") == 0 || strcmp(argument, "off") == 0) {
+        trace_enabled = strcmp(argument, "on") == 0;
+        show_message("trace %s", argument);
+        return TRUE;
+    }
+    if (strncmp(argument, "dump", 4) != 0 || (argument[4] != '\0' && argument[4] != ' ')) return FALSE;
+    char *file = trace_dump_file(get_function_argument(argument));
+    if (file == NULL) return FALSE;
+    show_message("trace written to %s", file);
+    g_free(file);
+    return TRUE;
+}
 
 /*!
- * Print log (debug) message with format specifiers.
+ * Log message with format specifiers, called through print_line.
+ * The event is recorded in the trace ring and, with debug messages,
+ * printed to stderr.
  *
- * \param level string with level of the message
- * \param format string and format specifiers for vfprintf function
+ * \param level LEVEL_* value
+ * \param format string literal and format specifiers for vfprintf function
  * \return 0 on success
  */
-static int print_line(char *level, char *format, ...) {
-    if (!debug_mode) {
-        return 0;
+static int trace_event(int level, const char *format, ...) {
+    va_list args;
+    if (debug_mode) {
+        va_start(args, format);
+        fprintf(stderr, "%s[ %s%s%s ] ", TERM_ATTR_BOLD, TERM_ATTR_COLOR, trace_levels[level], TERM_ATTR_DEFAULT);
+        vfprintf(stderr, format, args);
+        fprintf(stderr, "%s\n", TERM_ATTR_OFF);
+        va_end(args);
+    }
+    if (trace_enabled) {
+        va_start(args, format);
+        trace_record(level, format, args);
+        va_end(args);
     }
-    fprintf(stderr, "%s[ %s%s%s ] ", TERM_ATTR_BOLD, TERM_ATTR_COLOR, level,TERM_ATTR_DEFAULT);
-    va_start(vargs, format);
-    vfprintf(stderr, format, vargs);
-    va_end(vargs);
-    fprintf(stderr, "%s", TERM_ATTR_OFF);
-    fprintf(stderr, "\n");
     return 0;
 }
 
 /*!
- * Handle text selection inside terminal
+ * Return the selected text of a terminal, extracted once per selection.
+ *
+ * \param terminal
+ * \return selected text or NULL, owned by the terminal
+ */
+static char* get_selection_text(GtkWidget *terminal) {
+    char *text = g_object_get_data(G_OBJECT(terminal), "selection_text");
+    if (text == NULL && vte_terminal_get_has_selection(VTE_TERMINAL(terminal))) {
+        print_line(LEVEL_TRACE,"Extract selected text");
+        text = vte_terminal_get_text_selected(VTE_TERMINAL(terminal), VTE_FORMAT_TEXT);
+        g_object_set_data_full(G_OBJECT(terminal), "selection_text", text, g_free);
+    }
+    return text;
+}
+
+/*!
+ * Clipboard request from an application, provide the selected text.
+ *
+ * \param clipboard
+ * \param selection_data
+ * \param info
+ * \param owner terminal
+ */
+static void on_selection_get(GtkClipboard *clipboard, GtkSelectionData *selection_data, guint info, gpointer owner) {
+    UNUSED(clipboard);
+    UNUSED(info);
+    char *text = get_selection_text(owner);
+    if (text != NULL) gtk_selection_data_set_text(selection_data, text, -1);
+}
+
+/*!
+ * Clipboard taken by another owner, forget the selected text.
+ *
+ * \param clipboard
+ * \param owner terminal
+ */
+static void on_selection_clear(GtkClipboard *clipboard, gpointer owner) {
+    UNUSED(clipboard);
+    g_object_set_data(G_OBJECT(owner), "selection_owner", NULL);
+    g_object_set_data(G_OBJECT(owner), "selection_text", NULL);
+}
+
+/*!
+ * Timeout callback, extract the selection once it is stable.
+ *
+ * \param user_data terminal
+ * \return G_SOURCE_REMOVE
+ */
+static gboolean on_selection_settled(gpointer user_data) {
+    GtkWidget *terminal = user_data;
+    g_object_steal_data(G_OBJECT(terminal), "selection_id");
+    if (g_object_get_data(G_OBJECT(terminal), "selection_drag") == NULL)
+        get_selection_text(terminal);
+    return G_SOURCE_REMOVE;
+}
+
+/*!
+ * Track the mouse drag that builds a selection.
+ *
+ * \param terminal
+ * \param event
+ * \param user_data
+ * \return FALSE, the event is handled by the terminal too
+ */
+static gboolean on_terminal_button(GtkWidget *terminal, GdkEventButton *event, gpointer user_data) {
+    UNUSED(user_data);
+    if (event->button != 1) return FALSE;
+    if (event->type == GDK_BUTTON_PRESS) {
+        g_object_set_data(G_OBJECT(terminal), "search_selection", NULL);
+        g_object_set_data(G_OBJECT(terminal), "selection_drag", GINT_TO_POINTER(TRUE));
+    } else if (event->type == GDK_BUTTON_RELEASE) {
+        g_object_set_data(G_OBJECT(terminal), "selection_drag", NULL);
+        if (g_object_get_data(G_OBJECT(terminal), "selection_owner") != NULL) {
+            print_line(LEVEL_TRACE,"Selection drag ended");
+            get_selection_text(terminal);
+        }
+    }
+    return FALSE;
+}
+
+/*!
+ * Handle text selection inside terminal.
+ * With copy on selection the clipboard is claimed once and the text is
+ * extracted when the drag ends, when the selection is stable or when an
+ * application asks for it.
  *
  * \param terminal
  * \param user_data
  */
 static void on_terminal_selection(VteTerminal *terminal, gpointer user_data) {
-    print_line("info","Selection change on terminal");
+    print_line(LEVEL_INFO,"Selection change on terminal");
+    UNUSED(user_data);
+    if (!copy_on_selection || !vte_terminal_get_has_selection(terminal)) return;
+    GObject *owner = G_OBJECT(terminal);
+    if (g_object_get_data(owner, "search_selection") != NULL) {
+        print_line(LEVEL_TRACE,"Selection of a search match, clipboard not claimed");
+        return;
+    }
+    g_object_set_data(owner, "selection_text", NULL);
+    if (g_object_get_data(owner, "selection_owner") == NULL) {
+        static GtkTargetEntry *targets = NULL;
+        static gint n_targets = 0;
+        if (targets == NULL) {
+            GtkTargetList *list = gtk_target_list_new(NULL, 0);
+            gtk_target_list_add_text_targets(list, 0);
+            targets = gtk_target_table_new_from_list(list, &n_targets);
+            gtk_target_list_unref(list);
+        }
+        print_line(LEVEL_TRACE,"Claim clipboard for selection");
+        GtkClipboard *clipboard = gtk_widget_get_clipboard(GTK_WIDGET(terminal), GDK_SELECTION_CLIPBOARD);
+        if (gtk_clipboard_set_with_owner(clipboard, targets, n_targets, on_selection_get, on_selection_clear, owner))
+            g_object_set_data(owner, "selection_owner", GINT_TO_POINTER(TRUE));
+    }
+    guint source_id = g_timeout_add(SELECTION_SETTLE_DELAY, on_selection_settled, terminal);
+    g_object_set_data_full(owner, "selection_id", GUINT_TO_POINTER(source_id), remove_source);
+}
+
+/*!
+ * Return TRUE if the startup phase is already recorded.
+ *
+ * \param name phase name
+ */
+static gboolean profile_has_mark(char *name) {
+    for (int i = 0; i < profile_count; i++)
+        if (strcmp(profile_marks[i].name, name) == 0) return TRUE;
+    return FALSE;
+}
+
+/*!
+ * Print the startup profile to stderr, as text or json.
+ */
+static void profile_report() {
+    gint64 previous = profile_start;
+    if (profile_mode == PROFILE_JSON) fprintf(stderr, "{\"startup\":[");
+    for (int i = 0; i < profile_count; i++) {
+        double at = (profile_marks[i].time - profile_start) / 1000.0;
+        double delta = (profile_marks[i].time - previous) / 1000.0;
+        if (profile_mode == PROFILE_JSON)
+            fprintf(stderr, "%s{\"phase\":\"%s\",\"at_ms\":%.3f,\"delta_ms\":%.3f}", i > 0 ? "," : "", profile_marks[i].name, at, delta);
+        else
+            fprintf(stderr, "%s[ %sprofile%s ] %-40s +%9.3f ms %9.3f ms%s\n", TERM_ATTR_BOLD, TERM_ATTR_COLOR, TERM_ATTR_DEFAULT, profile_marks[i].name, delta, at, TERM_ATTR_OFF);
+        previous = profile_marks[i].time;
+    }
+    if (profile_mode == PROFILE_JSON) fprintf(stderr, "]}\n");
+}
+
+/*!
+ * Record the end of a startup phase, only the first occurrence of each
+ * phase is kept. The profile is printed when the first terminal is both
+ * painted and spawned.
+ *
+ * \param name phase name
+ */
+static void profile_mark(char *name) {
+    if (profile_mode == PROFILE_OFF || profile_count >= PROFILE_MAX_MARKS || profile_has_mark(name)) return;
+    profile_marks[profile_count].name = g_strdup(name);
+    profile_marks[profile_count].time = g_get_monotonic_time();
+    profile_count++;
+    if (profile_has_mark("first_paint") && profile_has_mark("child_spawned")) {
+        profile_report();
+        profile_mode = PROFILE_OFF;
+    }
+}
+
+/*!
+ * Handle first map of window for startup profile.
+ */
+static gboolean on_profile_map(GtkWidget *widget, GdkEvent *event, gpointer user_data) {
+    UNUSED(event);
+    UNUSED(user_data);
+    profile_mark("first_map");
+    g_signal_handlers_disconnect_by_func(widget, on_profile_map, NULL);
+    return FALSE;
+}
+
+/*!
+ * Handle first draw of terminal for startup profile.
+ */
+static gboolean on_profile_draw(GtkWidget *widget, gpointer cr, gpointer user_data) {
+    UNUSED(cr);
+    UNUSED(user_data);
+    profile_mark("first_paint");
+    g_signal_handlers_disconnect_by_func(widget, on_profile_draw, NULL);
+    return FALSE;
+}
+
+/*!
+ * Return the pane of a terminal.
+ *
+ * \param terminal
+ * \return pane or NULL if terminal is not in a tab
+ */
+static Pane* get_pane(GtkWidget *terminal) {
+    return panes != NULL ? g_hash_table_lookup(panes, terminal) : NULL;
+}
+
+/*!
+ * Return the most recently focused panes of a tab.
+ *
+ * \param tab notebook page
+ * \return queue of panes
+ */
+static GQueue* get_tab_panes(GtkWidget *tab) {
+    GQueue *tab_panes = g_object_get_data(G_OBJECT(tab), "panes");
+    if (tab_panes == NULL) {
+        tab_panes = g_queue_new();
+        g_object_set_data_full(G_OBJECT(tab), "panes", tab_panes, (GDestroyNotify)g_queue_free);
+    }
+    return tab_panes;
+}
+
+/*!
+ * Return the position of a split as fraction of its size.
+ *
+ * \param paned split
+ * \return ratio, the restored one until the split is allocated
+ */
+static double get_split_ratio(GtkWidget *paned) {
+    double *pending = g_object_get_data(G_OBJECT(paned), "ratio");
+    if (pending != NULL) return *pending;
+    gboolean horizontal = gtk_orientable_get_orientation(GTK_ORIENTABLE(paned)) == GTK_ORIENTATION_HORIZONTAL;
+    int size = horizontal ? gtk_widget_get_allocated_width(paned) : gtk_widget_get_allocated_height(paned);
+    return size > 1 ? (double)gtk_paned_get_position(GTK_PANED(paned)) / size : 0.5;
+}
+
+/*!
+ * Store in the pane the split that holds it and the split position.
+ *
+ * \param pane
+ */
+static void track_split(Pane *pane) {
+    GtkWidget *parent = gtk_widget_get_parent(pane->terminal);
+    pane->split = parent != NULL && parent != pane->tab && GTK_IS_PANED(parent) ? parent : NULL;
+    pane->split_ratio = pane->split != NULL ? get_split_ratio(pane->split) : 1.0;
+}
+
+/*!
+ * Remove pane from registry, called when the terminal is destroyed.
+ *
+ * \param terminal
+ * \param user_data
+ */
+static void unregister_pane(GtkWidget *terminal, gpointer user_data) {
     UNUSED(user_data);
-    if (copy_on_selection && vte_terminal_get_has_selection(terminal)) {
-        print_line("trace","Terminal contains selected text, put into clipboard if copy on selection");
-        vte_terminal_copy_clipboard_format(VTE_TERMINAL(terminal), VTE_FORMAT_TEXT);
+    Pane *pane = get_pane(terminal);
+    if (pane == NULL) return;
+    print_line(LEVEL_TRACE,"Unregister pane %u", pane->id);
+    g_queue_unlink(&pane_mru, &pane->mru_link);
+    g_queue_unlink(get_tab_panes(pane->tab), &pane->tab_link);
+    g_hash_table_remove(panes_by_id, GUINT_TO_POINTER(pane->id));
+    g_hash_table_remove(panes, terminal);
+    if (current_terminal == terminal) current_terminal = NULL;
+    g_free(pane);
+}
+
+/*!
+ * Add terminal to the registry as pane of a tab.
+ *
+ * \param terminal
+ * \param tab notebook page
+ * \return pane
+ */
+static Pane* register_pane(GtkWidget *terminal, GtkWidget *tab) {
+    if (panes == NULL) {
+        panes = g_hash_table_new(g_direct_hash, g_direct_equal);
+        panes_by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+    Pane *pane = g_new0(Pane, 1);
+    pane->id = pane_next_id++;
+    pane->terminal = terminal;
+    pane->tab = tab;
+    pane->mru_link.data = pane;
+    pane->tab_link.data = pane;
+    g_queue_push_head_link(&pane_mru, &pane->mru_link);
+    g_queue_push_head_link(get_tab_panes(tab), &pane->tab_link);
+    g_hash_table_insert(panes, terminal, pane);
+    g_hash_table_insert(panes_by_id, GUINT_TO_POINTER(pane->id), pane);
+    g_signal_connect(terminal, "destroy", G_CALLBACK(unregister_pane), NULL);
+    track_split(pane);
+    print_line(LEVEL_TRACE,"Register pane %u", pane->id);
+    if (log_all) toggle_log(terminal);
+    if (zoom_window && notebook != NULL) {
+        /* New terminals of a zoomed window get its font size */
+        int size = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(gtk_widget_get_toplevel(notebook)), "font_size"));
+        if (size > 0) set_terminal_font(terminal, size);
+    }
+    return pane;
+}
+
+/*!
+ * Move pane in front of the most recently used queues.
+ *
+ * \param pane
+ */
+static void touch_pane(Pane *pane) {
+    GQueue *tab_panes = get_tab_panes(pane->tab);
+    g_queue_unlink(&pane_mru, &pane->mru_link);
+    g_queue_push_head_link(&pane_mru, &pane->mru_link);
+    g_queue_unlink(tab_panes, &pane->tab_link);
+    g_queue_push_head_link(tab_panes, &pane->tab_link);
+}
+
+/*!
+ * Focus the most recently used pane of a tab.
+ *
+ * \param tab notebook page
+ * \return TRUE if the tab has a pane
+ */
+static gboolean focus_tab(GtkWidget *tab) {
+    GList *head = g_queue_peek_head_link(get_tab_panes(tab));
+    if (head == NULL) return FALSE;
+    Pane *pane = head->data;
+    print_line(LEVEL_TRACE,"Focus pane %u", pane->id);
+    gtk_widget_grab_focus(pane->terminal);
+    return TRUE;
+}
+
+/*!
+ * Close a window, quit the application unless running as server.
+ *
+ * \param win window to close
+ */
+static void close_window(GtkWidget *win) {
+    if (!server_mode) {
+        gtk_main_quit();
+        return;
     }
+    print_line(LEVEL_INFO,"Close window");
+    gtk_widget_destroy(win);
+}
+
+/*!
+ * Replace a split that has one child with the child, in the same
+ * position of the parent split.
+ *
+ * \param paned split with one child
+ */
+static void collapse_split(GtkWidget *paned) {
+    GtkWidget *child = gtk_paned_get_child1(GTK_PANED(paned));
+    if (child == NULL) child = gtk_paned_get_child2(GTK_PANED(paned));
+    if (child == NULL || (gtk_paned_get_child1(GTK_PANED(paned)) != NULL && gtk_paned_get_child2(GTK_PANED(paned)) != NULL)) return;
+    print_line(LEVEL_TRACE,"Split with one side, replace it with the child");
+    GtkWidget *parent = gtk_widget_get_parent(paned);
+    gboolean first = gtk_paned_get_child1(GTK_PANED(parent)) == paned;
+    g_object_ref(child);
+    gtk_container_remove(GTK_CONTAINER(paned), child);
+    gtk_widget_destroy(paned);
+    if (first) gtk_paned_pack1(GTK_PANED(parent), child, TRUE, TRUE);
+    else gtk_paned_pack2(GTK_PANED(parent), child, TRUE, TRUE);
+    g_object_unref(child);
+    Pane *pane = VTE_IS_TERMINAL(child) ? get_pane(child) : NULL;
+    if (pane != NULL) track_split(pane);
 }
 
 /*!
@@ -126,59 +830,38 @@ static void on_terminal_selection(VteTerminal *terminal, gpointer user_data) {
  * \return TRUE on exit, not continue
  */
 static gboolean on_terminal_exit(VteTerminal *terminal, gint status, gpointer user_data) {
-    print_line("info","Exit from terminal");
+    print_line(LEVEL_INFO,"Exit from terminal");
     UNUSED(user_data);
     GtkWidget *term_widget = GTK_WIDGET(terminal);
+    if (terminal_pool != NULL && g_queue_remove(terminal_pool, term_widget)) {
+        print_line(LEVEL_WARNING,"Pooled terminal exited, drop it");
+        gtk_widget_destroy(term_widget);
+        fill_terminal_pool();
+        return TRUE;
+    }
+    Pane *pane = get_pane(term_widget);
+    if (pane == NULL) return TRUE;
+    cancel_paste(term_widget);
+    GtkWidget *tab = pane->tab;
     GtkWidget *parent = gtk_widget_get_parent(term_widget);
-    if (GTK_IS_CONTAINER(parent)) {
-        gtk_container_remove(GTK_CONTAINER(parent), term_widget);
-        while (parent != NULL) {
-            if (GTK_IS_NOTEBOOK(parent)) {
-                print_line("trace","Parent is notebook");
-                GtkWidget *current_page = gtk_notebook_get_nth_page (GTK_NOTEBOOK(notebook), gtk_notebook_get_current_page(GTK_NOTEBOOK(notebook)));
-                if (GTK_IS_CONTAINER(current_page)) {
-                    GList *page_children = gtk_container_get_children(GTK_CONTAINER(current_page));
-                    while (page_children != NULL && GTK_IS_CONTAINER(page_children->data))
-                        page_children = gtk_container_get_children(GTK_CONTAINER(page_children->data));
-                    if (page_children != NULL && GTK_IS_WIDGET(page_children->data)) {
-                        print_line("trace","Found a child widget");
-                        if (gtk_widget_get_can_focus(GTK_WIDGET(page_children->data))) {
-                            print_line("trace", "Set focus on child widget");
-                            gtk_widget_grab_focus(page_children->data);
-                            return TRUE;
-                        }
-                    }
-                } 
-                print_line("warning","Empty notebook page, remove it");
-                gtk_notebook_remove_page(GTK_NOTEBOOK(notebook), gtk_notebook_get_current_page(GTK_NOTEBOOK(notebook)));
-                gtk_widget_queue_draw(GTK_WIDGET(notebook));
-                if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) < 1) { gtk_main_quit(); }
-                return TRUE;
-            } else if (GTK_IS_PANED(parent)) {
-                print_line("trace","Parent is box");
-                GList *children = gtk_container_get_children(GTK_CONTAINER(parent));
-                while (children != NULL && GTK_IS_CONTAINER(children->data))
-                    children = gtk_container_get_children(GTK_CONTAINER(children->data));
-                if (children != NULL && GTK_IS_WIDGET(children->data)) {
-                    print_line("trace","Found a child widget in the box");
-                    if (gtk_widget_get_can_focus(GTK_WIDGET(children->data))) {
-                        print_line("trace", "Set focus on child widget");
-                        gtk_widget_grab_focus(children->data);
-                        return TRUE;
-                    }
-                } else {
-                    print_line("warning","Empty box, remove it");
-                }
-            } else if (gtk_widget_get_can_focus(parent)) {
-                print_line("trace","Focus directly on parent");
-                gtk_widget_grab_focus(parent);
-                return TRUE;
-            }
-            GtkWidget *sup_parent = gtk_widget_get_parent(parent);
-            if (sup_parent != NULL) gtk_container_remove(GTK_CONTAINER(sup_parent), parent);
-            parent = sup_parent;
-        }
+    gtk_widget_destroy(term_widget);
+    /* Remove the splits left empty, up to the tab */
+    while (parent != tab && GTK_IS_PANED(parent) &&
+            gtk_paned_get_child1(GTK_PANED(parent)) == NULL && gtk_paned_get_child2(GTK_PANED(parent)) == NULL) {
+        print_line(LEVEL_TRACE,"Empty box, remove it");
+        GtkWidget *sup_parent = gtk_widget_get_parent(parent);
+        gtk_widget_destroy(parent);
+        parent = sup_parent;
     }
+    /* A split left with one side is replaced by that side */
+    if (parent != tab && GTK_IS_PANED(parent) && GTK_IS_PANED(gtk_widget_get_parent(parent)))
+        collapse_split(parent);
+    if (focus_tab(tab)) return TRUE;
+    print_line(LEVEL_WARNING,"Empty notebook page, remove it");
+    GtkWidget *term_notebook = gtk_widget_get_parent(tab);
+    gtk_notebook_remove_page(GTK_NOTEBOOK(term_notebook), gtk_notebook_page_num(GTK_NOTEBOOK(term_notebook), tab));
+    gtk_widget_queue_draw(term_notebook);
+    if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(term_notebook)) < 1) close_window(gtk_widget_get_toplevel(term_notebook));
     return TRUE;
 }
 
@@ -193,28 +876,23 @@ static gboolean on_terminal_exit(VteTerminal *terminal, gint status, gpointer us
 static gboolean on_command(GtkWidget *self, GdkEventKey* event, gpointer user_data) {
     UNUSED(user_data);
     if (strcmp(gdk_keyval_name(event->keyval),"Return") == 0) {
-        char* function = g_strconcat(gtk_entry_get_text(GTK_ENTRY(commander)), NULL);
-        print_line("trace","Invoke function %s", function);
-        if (execute_function(function)) {
+        char* function = g_strdup(gtk_entry_get_text(GTK_ENTRY(commander)));
+        print_line(LEVEL_TRACE,"Invoke function %s", function);
+        gboolean valid = execute_function(function);
+        g_free(function);
+        if (valid) {
             show_hide_commander();
             gtk_widget_grab_focus(current_terminal);
             return TRUE;
         }
     } else {
-        char* search_code = "";
-        if (event->state & GDK_CONTROL_MASK) search_code = g_strconcat(search_code,"Control+",NULL);
-        if (event->state & GDK_SHIFT_MASK) search_code = g_strconcat(search_code,"Shift+",NULL);
-        if (event->state & GDK_MOD1_MASK) search_code = g_strconcat(search_code,"Mod1+",NULL);
-        if (event->state & (GDK_SUPER_MASK | GDK_META_MASK)) search_code = g_strconcat(search_code,"Meta+",NULL);
-        search_code = g_strconcat(search_code,gdk_keyval_name(event->keyval),NULL);
-        char* function = g_hash_table_lookup(hotkeys,search_code);
-        if (function != NULL) {
-            print_line("trace","Hotkey code: %s", search_code);
-            if (get_function(function) == FUNCTION_COMMAND) {
-                show_hide_commander();
-                gtk_widget_grab_focus(current_terminal);
-                return TRUE;
-            }
+        gint64 code = get_hotkey_code(event->keyval, event->state);
+        Binding *binding = g_hash_table_lookup(hotkeys, &code);
+        if (binding != NULL && binding->function == FUNCTION_COMMAND) {
+            print_line(LEVEL_TRACE,"Hotkey code: %" G_GINT64_FORMAT, code);
+            show_hide_commander();
+            gtk_widget_grab_focus(current_terminal);
+            return TRUE;
         }
     }
     return FALSE;
@@ -231,8 +909,10 @@ static gboolean on_command(GtkWidget *self, GdkEventKey* event, gpointer user_da
  */
 static gboolean has_focus(GtkWidget* terminal, GdkEventFocus event, gpointer user_data) {
     UNUSED(user_data);
-    print_line("trace","Get focus");
+    print_line(LEVEL_TRACE,"Get focus");
     current_terminal = terminal;
+    Pane *pane = get_pane(terminal);
+    if (pane != NULL) touch_pane(pane);
     return FALSE;
 }
 
@@ -247,523 +927,3310 @@ static gboolean has_focus(GtkWidget* terminal, GdkEventFocus event, gpointer use
 static gboolean focus_change(GtkWidget* terminal, GdkEventMotion event, gpointer user_data) {
     UNUSED(user_data);
     if (focus_follow_mouse && !gtk_widget_is_focus(terminal)) {
-        print_line("trace","Focus change");
+        print_line(LEVEL_TRACE,"Focus change");
         gtk_widget_grab_focus(terminal);
     }
     return FALSE;
 }
 
 /*!
- * Handle terminal key press events.
+ * Add a sample to latency histogram.
  *
- * \param terminal
- * \param event (key press or release)
- * \param user_data
- * \return FALSE on normal press & TRUE on custom actions
+ * \param histogram
+ * \param usec latency in microseconds
  */
-static gboolean on_hotkey(GtkWidget *terminal, GdkEventKey *event,gpointer user_data) {
-    print_line("info","Hotkey method");
-    UNUSED(user_data);
-    if (event->is_modifier == 0) {
-        char* search_code = "";
-        if (event->state & GDK_CONTROL_MASK) search_code = g_strconcat(search_code,"Control+",NULL);
-        if (event->state & GDK_SHIFT_MASK) search_code = g_strconcat(search_code,"Shift+",NULL);
-        if (event->state & GDK_MOD1_MASK) search_code = g_strconcat(search_code,"Mod1+",NULL);
-        if (event->state & (GDK_SUPER_MASK | GDK_META_MASK)) search_code = g_strconcat(search_code,"Meta+",NULL);
-        search_code = g_strconcat(search_code,gdk_keyval_name(event->keyval),NULL);
-        print_line("trace","Hotkey code: %s", search_code);
-        char* function = g_hash_table_lookup(hotkeys,search_code);
-        if (function == NULL) return FALSE;
-        print_line("trace","Invoke function: %s (%d)", function, get_function(function));
-        current_terminal = terminal;
-        return execute_function(function);
-    }
-    return FALSE;
+static void latency_record(LatencyHistogram *histogram, gint64 usec) {
+    histogram->buckets[MIN(usec / LATENCY_BUCKET_USEC, LATENCY_BUCKETS)]++;
+    histogram->count++;
+    if (usec > histogram->max) histogram->max = usec;
 }
 
 /*!
- * Function for execute specific command in current terminal.
+ * Return the latency percentile, upper bound of the bucket.
  *
- * \param function exec <command to exec>
- * \return TRUE if valid page or FALSE.
+ * \param histogram
+ * \param percentile 0-100
+ * \return latency in microseconds
  */
-static gboolean send_command_to_terminal(char* function) {
-    print_line("info","send_command_to_terminal");
-    char* page_str = strtok(function, " ");
-    gboolean completed=FALSE;
-    page_str = strtok(NULL, " ");
-    while (page_str != NULL) {
-        vte_terminal_feed_child(VTE_TERMINAL(current_terminal),page_str,-1);
-        vte_terminal_feed_child(VTE_TERMINAL(current_terminal)," ",-1);
-        page_str = strtok(NULL, " ");
-        completed=TRUE;
+static gint64 latency_percentile(LatencyHistogram *histogram, int percentile) {
+    guint64 target = ((guint64)histogram->count * percentile + 99) / 100;
+    guint64 seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= target) return MIN((gint64)(i + 1) * LATENCY_BUCKET_USEC, histogram->max);
     }
-    if (completed) vte_terminal_feed_child(VTE_TERMINAL(current_terminal),"\n",-1);
-    return completed;
+    return histogram->max;
 }
 
 /*!
- * Function for go to specific page, show specific tab of notebook.
+ * Merge latency histogram into another one.
+ */
+static void latency_merge(LatencyHistogram *to, LatencyHistogram *from) {
+    for (int i = 0; i <= LATENCY_BUCKETS; i++) to->buckets[i] += from->buckets[i];
+    to->count += from->count;
+    if (from->max > to->max) to->max = from->max;
+}
+
+/*!
+ * Keep latency of closed terminals in the totals.
  *
- * \param function goto <page number>
- * \return TRUE if valid page or FALSE.
+ * \param data LatencyStats
  */
-static gboolean go_to(char* function) {
-    print_line("info","go_to");
-    char* page_str = strtok(function, " ");
-    page_str = strtok(NULL, " ");
-    print_line("trace","Go to page %s", page_str);
-    gint page_num = atoi(page_str);
-    page_num--;
-    if (page_num >= 0 && page_num <= gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook))) {
-        print_line("trace","Page number int value: %d",page_num);
-        gtk_notebook_set_current_page(GTK_NOTEBOOK(notebook),page_num);
-        GtkWidget* page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook),page_num);
-        GList* children = gtk_container_get_children(GTK_CONTAINER(page));
-        while (children != NULL) {
-            if (VTE_IS_TERMINAL(children->data)) {
-                print_line("trace","Set focus on terminal");
-                gtk_widget_grab_focus(GTK_WIDGET(children->data));
-                return TRUE;
-            } else if (GTK_IS_CONTAINER(children->data)) {
-                print_line("trace","Is container, loop inside");
-                children = gtk_container_get_children(GTK_CONTAINER(children->data));
-            } else if (GTK_IS_WIDGET(children->data)) {
-                print_line("trace","Is a widget set focus on it and iterate to next");
-                gtk_widget_grab_focus(GTK_WIDGET(children->data));
-                children = children->next;
-            }
-        }
-        print_line("warning","Valid terminal not found");
-        return TRUE;
+static void free_latency_stats(gpointer data) {
+    LatencyStats *latency = data;
+    latency_merge(&latency_closed.output, &latency->output);
+    latency_merge(&latency_closed.paint, &latency->paint);
+    g_free(latency);
+}
+
+/*!
+ * Store key press time for latency measure.
+ * The first key press without output is kept, keys typed before the echo
+ * arrives would make the measured latency too low.
+ *
+ * \param terminal
+ * \param key_time monotonic time of key press, 0 when latency mode is off
+ * \return FALSE, propagate event to terminal
+ */
+static gboolean latency_key_press(GtkWidget *terminal, gint64 key_time) {
+    if (key_time != 0) {
+        LatencyStats *latency = g_object_get_data(G_OBJECT(terminal), "latency");
+        if (latency->key_time != 0 && key_time - latency->key_time <= LATENCY_MAX_WAIT_USEC) return FALSE;
+        latency->key_time = key_time;
+        latency->output_time = 0;
+        latency->committed = FALSE;
     }
     return FALSE;
 }
 
 /*!
- * Parse string command and invoke correct function
+ * Handle text sent to the child process for latency measure, only the
+ * output that follows a key sent to the child is an echo of the key.
  *
- * \param function string with command
- * \return TRUE if command is valid.
+ * \param terminal
+ * \param text
+ * \param size
+ * \param user_data
  */
-static gboolean execute_function(char* function) {
-    print_line("info","execute_function");
-    switch (get_function(function)) {
-        case FUNCTION_COPY:
-            vte_terminal_copy_clipboard_format(VTE_TERMINAL(current_terminal), VTE_FORMAT_TEXT);
-            return TRUE;
-        case FUNCTION_PASTE:
-            vte_terminal_paste_clipboard(VTE_TERMINAL(current_terminal));
-            return TRUE;
-        case FUNCTION_RELOAD:
-            if (default_config_file) parse_settings(get_default_config_file_name());
-            else parse_settings(config_file_name);
-            apply_terminal_settings(current_terminal);
-            return TRUE;
-        case FUNCTION_QUIT:
-            gtk_main_quit();
-            return TRUE;
-        case FUNCTION_FONT_INC:
-            set_terminal_font(current_terminal, current_font_size + 1);
-            return TRUE;
-        case FUNCTION_FONT_DEC:
-            set_terminal_font(current_terminal, current_font_size - 1);
-            return TRUE;
-        case FUNCTION_FONT_RESET:
-            set_terminal_font(current_terminal, default_font_size);
-            return TRUE;
-        case FUNCTION_SPLIT_V:
-            add_terminal_next_to(TRUE);
-            return TRUE;
-        case FUNCTION_SPLIT_H:
-            add_terminal_next_to(FALSE);
-            return TRUE;
-        case FUNCTION_NEW_TAB:
-            add_new_tab();
-            return TRUE;
-        case FUNCTION_PREV:
-            gtk_notebook_prev_page(GTK_NOTEBOOK(notebook));
-            return TRUE;
-        case FUNCTION_NEXT:
-            gtk_notebook_next_page(GTK_NOTEBOOK(notebook));
-            return TRUE;
-        case FUNCTION_CLOSE:
-            if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) > 1) {
-                gtk_notebook_remove_page(GTK_NOTEBOOK(notebook),gtk_notebook_get_current_page(GTK_NOTEBOOK(notebook)));
-                gtk_widget_queue_draw(GTK_WIDGET(notebook));
-            }
+static void on_latency_commit(VteTerminal *terminal, gchar *text, guint size, gpointer user_data) {
+    UNUSED(text);
+    UNUSED(size);
+    UNUSED(user_data);
+    LatencyStats *latency = g_object_get_data(G_OBJECT(terminal), "latency");
+    if (latency->key_time != 0) latency->committed = TRUE;
+}
+
+/*!
+ * Handle terminal contents change for latency measure.
+ *
+ * \param terminal
+ * \param user_data
+ */
+static void on_latency_output(VteTerminal *terminal, gpointer user_data) {
+    UNUSED(user_data);
+    LatencyStats *latency = g_object_get_data(G_OBJECT(terminal), "latency");
+    /* Background output before the key reached the child is not an echo */
+    if (latency->key_time == 0 || !latency->committed || latency->output_time != 0) return;
+    gint64 now = g_get_monotonic_time();
+    if (now - latency->key_time > LATENCY_MAX_WAIT_USEC) {
+        latency->key_time = 0;
+        return;
+    }
+    latency->output_time = now;
+    latency_record(&latency->output, now - latency->key_time);
+}
+
+/*!
+ * Handle terminal draw for latency measure, first paint after output.
+ *
+ * \param terminal
+ * \param cr
+ * \param user_data
+ * \return FALSE, propagate event
+ */
+static gboolean on_latency_draw(GtkWidget *terminal, gpointer cr, gpointer user_data) {
+    UNUSED(cr);
+    UNUSED(user_data);
+    LatencyStats *latency = g_object_get_data(G_OBJECT(terminal), "latency");
+    if (latency->output_time != 0) {
+        latency_record(&latency->paint, g_get_monotonic_time() - latency->key_time);
+        latency->key_time = 0;
+        latency->output_time = 0;
+    }
+    return FALSE;
+}
+
+/*!
+ * Append latency report line.
+ *
+ * \param report
+ * \param name pane name
+ * \param latency
+ */
+static void append_latency(GString *report, char *name, LatencyStats *latency) {
+    g_string_append_printf(report, "%s: keys %u output p50 %.1f p99 %.1f max %.1f ms, paint p50 %.1f p99 %.1f max %.1f ms\n", name,
+        latency->output.count,
+        latency_percentile(&latency->output, 50) / 1000.0, latency_percentile(&latency->output, 99) / 1000.0, latency->output.max / 1000.0,
+        latency_percentile(&latency->paint, 50) / 1000.0, latency_percentile(&latency->paint, 99) / 1000.0, latency->paint.max / 1000.0);
+}
+
+/*!
+ * Return latency report for all terminals.
+ *
+ * \return report, free with g_free
+ */
+static char* get_latency_report() {
+    GString *report = g_string_new(NULL);
+    GList *terminals = get_all_terminals();
+    for (GList *item = terminals; item != NULL; item = item->next) {
+        char *name = g_strdup_printf("pane %u", get_pane(item->data)->id);
+        append_latency(report, name, g_object_get_data(G_OBJECT(item->data), "latency"));
+        g_free(name);
+    }
+    g_list_free(terminals);
+    append_latency(report, "closed", &latency_closed);
+    return g_string_free(report, FALSE);
+}
+
+/*!
+ * Write latency report to output.
+ *
+ * \param output
+ */
+static void dump_latency(FILE *output) {
+    char *report = get_latency_report();
+    fputs(report, output);
+    g_free(report);
+}
+
+/*!
+ * Update the paste progress on the window command prompt.
+ *
+ * \param paste
+ * \param done TRUE when the paste is completed or cancelled
+ */
+static void show_paste_progress(Paste *paste, gboolean done) {
+    if (paste->length < PASTE_PROGRESS_SIZE) return;
+    GtkWidget *entry = g_object_get_data(G_OBJECT(gtk_widget_get_toplevel(paste->terminal)), "commander");
+    if (entry == NULL) return;
+    if (done) {
+        if (!paste->progress) return;
+        gtk_entry_set_progress_fraction(GTK_ENTRY(entry), 0);
+        gtk_entry_set_placeholder_text(GTK_ENTRY(entry), "Command:");
+        gtk_widget_hide(entry);
+        return;
+    }
+    /* The command prompt in use is left alone */
+    if (!paste->progress && gtk_widget_get_visible(entry)) return;
+    char *text = g_strdup_printf("Paste %" G_GSIZE_FORMAT "/%" G_GSIZE_FORMAT " KiB (Escape to cancel)", paste->offset / 1024, paste->length / 1024);
+    gtk_entry_set_placeholder_text(GTK_ENTRY(entry), text);
+    gtk_entry_set_progress_fraction(GTK_ENTRY(entry), (double)paste->offset / paste->length);
+    if (!paste->progress) {
+        paste->progress = TRUE;
+        gtk_widget_set_sensitive(entry, FALSE);
+        gtk_widget_show(entry);
+    }
+    g_free(text);
+}
+
+/*!
+ * Free a paste, destroy notify of terminal data.
+ *
+ * \param data Paste
+ */
+static void free_paste(gpointer data) {
+    Paste *paste = data;
+    if (paste->source_id != 0) g_source_remove(paste->source_id);
+    g_free(paste->text);
+    g_free(paste);
+}
+
+/*!
+ * End the paste of a terminal, completed or not, and clear its progress.
+ *
+ * \param paste
+ */
+static void finish_paste(Paste *paste) {
+    show_paste_progress(paste, TRUE);
+    g_object_set_data(G_OBJECT(paste->terminal), "paste", NULL);
+}
+
+/*!
+ * Cancel the paste in progress on a terminal.
+ *
+ * \param terminal
+ * \return TRUE if a paste was in progress
+ */
+static gboolean cancel_paste(GtkWidget *terminal) {
+    Paste *paste = g_object_get_data(G_OBJECT(terminal), "paste");
+    if (paste == NULL) return FALSE;
+    print_line(LEVEL_INFO,"Cancel paste");
+    finish_paste(paste);
+    return TRUE;
+}
+
+/*!
+ * Commit of the bracketed paste probe, record if the program asked for
+ * bracketed paste.
+ *
+ * \param terminal
+ * \param text
+ * \param size
+ * \param user_data gboolean set when the paste is bracketed
+ */
+static void on_paste_probe(VteTerminal *terminal, gchar *text, guint size, gpointer user_data) {
+    UNUSED(terminal);
+    if (size >= 6 && strncmp(text, "\033[200~", 6) == 0) *(gboolean*)user_data = TRUE;
+}
+
+/*!
+ * Return TRUE if the program of the terminal enabled bracketed paste.
+ * VTE does not expose the mode: an empty paste is sent through VTE, which
+ * brackets it when the mode is on. Programs ignore an empty bracketed paste.
+ *
+ * \param terminal
+ * \return TRUE if the paste must be bracketed
+ */
+static gboolean is_paste_bracketed(GtkWidget *terminal) {
+    gboolean bracketed = FALSE;
+    gulong probe_id = g_signal_connect(terminal, "commit", G_CALLBACK(on_paste_probe), &bracketed);
+    broadcasting = TRUE;
+    vte_terminal_paste_text(VTE_TERMINAL(terminal), "");
+    broadcasting = FALSE;
+    g_signal_handler_disconnect(terminal, probe_id);
+    return bracketed;
+}
+
+/*!
+ * Convert clipboard text as VTE does for a paste: newlines are sent as
+ * carriage returns and, with bracketed paste, the text is bracketed once
+ * and the escapes that could end the bracket early are removed.
+ *
+ * \param text clipboard text
+ * \param bracketed TRUE for bracketed paste
+ * \param length converted length
+ * \return converted text, free with g_free
+ */
+static char* convert_paste(const char *text, gboolean bracketed, gsize *length) {
+    GString *paste = g_string_sized_new(strlen(text) + 12);
+    if (bracketed) g_string_append(paste, "\033[200~");
+    for (const char *c = text; *c != '\0'; c++) {
+        if (*c == '\n') {
+            if (c == text || c[-1] != '\r') g_string_append_c(paste, '\r');
+        } else if (*c != '\033' || !bracketed) {
+            g_string_append_c(paste, *c);
+        }
+    }
+    if (bracketed) g_string_append(paste, "\033[201~");
+    *length = paste->len;
+    return g_string_free(paste, FALSE);
+}
+
+/*!
+ * Pty writable callback, write the next chunk to the pty.
+ * The write is non blocking: the chunk stops where the pty buffer is full
+ * and the rest waits until the program reads.
+ *
+ * \param fd pty file descriptor
+ * \param condition
+ * \param user_data Paste
+ * \return G_SOURCE_CONTINUE until the whole text is pasted
+ */
+static gboolean on_paste_writable(gint fd, GIOCondition condition, gpointer user_data) {
+    Paste *paste = user_data;
+    if (condition & (G_IO_ERR | G_IO_HUP)) {
+        print_line(LEVEL_WARNING,"Pty closed, drop paste");
+        paste->source_id = 0;
+        finish_paste(paste);
+        return G_SOURCE_REMOVE;
+    }
+    gssize written = write(fd, paste->text + paste->offset, MIN(PASTE_CHUNK_SIZE, paste->length - paste->offset));
+    if (written < 0) {
+        if (errno == EAGAIN || errno == EINTR) return G_SOURCE_CONTINUE;
+        print_line(LEVEL_WARNING,"Pty write failed, drop paste: %s", g_strerror(errno));
+        paste->source_id = 0;
+        finish_paste(paste);
+        return G_SOURCE_REMOVE;
+    }
+    paste->offset += written;
+    if (paste->offset < paste->length) {
+        show_paste_progress(paste, FALSE);
+        return G_SOURCE_CONTINUE;
+    }
+    print_line(LEVEL_TRACE,"Paste completed");
+    paste->source_id = 0;
+    finish_paste(paste);
+    return G_SOURCE_REMOVE;
+}
+
+/*!
+ * Clipboard text received, paste it at once when small or in chunks
+ * written to the pty as the program reads them.
+ *
+ * \param clipboard
+ * \param text clipboard content or NULL
+ * \param user_data terminal, referenced by paste_clipboard
+ */
+static void on_paste_text(GtkClipboard *clipboard, const gchar *text, gpointer user_data) {
+    UNUSED(clipboard);
+    GtkWidget *terminal = user_data;
+    VtePty *pty = vte_terminal_get_pty(VTE_TERMINAL(terminal));
+    if (text == NULL || *text == '\0' || pty == NULL || gtk_widget_in_destruction(terminal)) {
+        g_object_unref(terminal);
+        return;
+    }
+    gsize length = strlen(text);
+    print_line(LEVEL_INFO,"Paste %" G_GSIZE_FORMAT " bytes", length);
+    if (length <= PASTE_CHUNK_SIZE) {
+        broadcasting = TRUE;
+        vte_terminal_paste_text(VTE_TERMINAL(terminal), text);
+        broadcasting = FALSE;
+    } else {
+        Paste *paste = g_new0(Paste, 1);
+        paste->terminal = terminal;
+        paste->text = convert_paste(text, is_paste_bracketed(terminal), &paste->length);
+        g_unix_set_fd_nonblocking(vte_pty_get_fd(pty), TRUE, NULL);
+        g_object_set_data_full(G_OBJECT(terminal), "paste", paste, free_paste);
+        paste->source_id = g_unix_fd_add_full(G_PRIORITY_LOW, vte_pty_get_fd(pty), G_IO_OUT | G_IO_ERR | G_IO_HUP, on_paste_writable, paste, NULL);
+        show_paste_progress(paste, FALSE);
+    }
+    g_object_unref(terminal);
+}
+
+/*!
+ * Paste the clipboard content into a terminal without blocking the UI,
+ * a paste still in progress on the terminal is cancelled.
+ *
+ * \param terminal
+ */
+static void paste_clipboard(GtkWidget *terminal) {
+    cancel_paste(terminal);
+    gtk_clipboard_request_text(gtk_widget_get_clipboard(terminal, GDK_SELECTION_CLIPBOARD), on_paste_text, g_object_ref(terminal));
+}
+
+/*!
+ * Handle terminal key press events.
+ *
+ * \param terminal
+ * \param event (key press or release)
+ * \param user_data
+ * \return FALSE on normal press & TRUE on custom actions
+ */
+static gboolean on_hotkey(GtkWidget *terminal, GdkEventKey *event,gpointer user_data) {
+    print_line(LEVEL_INFO,"Hotkey method");
+    UNUSED(user_data);
+    if (event->keyval == GDK_KEY_Escape && chord == NULL && cancel_paste(terminal)) return TRUE;
+    if (event->is_modifier == 0) {
+        gint64 key_time = latency_mode ? g_get_monotonic_time() : 0;
+        gint64 code = get_hotkey_code(event->keyval, event->state);
+        print_line(LEVEL_TRACE,"Hotkey code: %" G_GINT64_FORMAT, code);
+        Binding *binding = g_hash_table_lookup(chord != NULL ? chord : hotkeys, &code);
+        if (binding == NULL) {
+            if (chord == NULL) return latency_key_press(terminal, key_time);
+            print_line(LEVEL_TRACE,"Key not in chord, discard it");
+            chord = NULL;
             return TRUE;
-        case FUNCTION_EXEC:
-            return send_command_to_terminal(function);
-        case FUNCTION_GOTO:
-            return go_to(function);
-        case FUNCTION_COMMAND:
-            show_hide_commander();
+        }
+        if (binding->chord != NULL) {
+            print_line(LEVEL_TRACE,"Chord prefix, wait next key");
+            chord = binding->chord;
             return TRUE;
+        }
+        chord = NULL;
+        print_line(LEVEL_TRACE,"Invoke function: %d", binding->function);
+        current_terminal = terminal;
+        if (run_function(binding->function, binding->argument)) return TRUE;
+        return latency_key_press(terminal, key_time);
+    }
+    return FALSE;
+}
+
+/*!
+ * Return the terminals of a scope: current terminal, its tab or all panes.
+ *
+ * \param scope SCOPE_* value
+ * \return list of terminals, free with g_list_free
+ */
+static GList* get_scope_terminals(int scope) {
+    GList *terminals = NULL;
+    if (current_terminal == NULL) return NULL;
+    if (scope == SCOPE_ALL) return get_all_terminals();
+    Pane *pane = get_pane(current_terminal);
+    if (scope == SCOPE_TAB && pane != NULL) {
+        for (GList *link = get_tab_panes(pane->tab)->tail; link != NULL; link = link->prev)
+            terminals = g_list_prepend(terminals, ((Pane*)link->data)->terminal);
+        return terminals;
+    }
+    return g_list_prepend(terminals, current_terminal);
+}
+
+/*!
+ * Send the same text to the child process of each terminal, one write per terminal.
+ *
+ * \param terminals list of terminals
+ * \param text text to send
+ * \param length text length or -1
+ * \param except terminal to skip or NULL
+ */
+static void feed_terminals(GList *terminals, const char *text, gssize length, GtkWidget *except) {
+    /* feed_child emits commit too, do not repeat the text to the synchronized terminals */
+    broadcasting = TRUE;
+    for (GList *item = terminals; item != NULL; item = item->next) {
+        if (item->data == except) continue;
+        vte_terminal_feed_child(VTE_TERMINAL(item->data), text, length);
+    }
+    broadcasting = FALSE;
+}
+
+/*!
+ * Function for execute specific command in the terminals of a scope.
+ * The command is sent as typed, spaces and quotes included, followed by a newline.
+ *
+ * \param argument <command to exec>
+ * \param scope SCOPE_* value
+ * \return TRUE if command is not empty.
+ */
+static gboolean send_command_to_terminal(char* argument, int scope) {
+    print_line(LEVEL_INFO,"send_command_to_terminal");
+    if (argument == NULL) return FALSE;
+    char *payload = g_strconcat(argument, "\n", NULL);
+    GList *terminals = get_scope_terminals(scope);
+    print_line(LEVEL_TRACE,"Send command to %d terminals", g_list_length(terminals));
+    feed_terminals(terminals, payload, -1, NULL);
+    g_list_free(terminals);
+    g_free(payload);
+    return TRUE;
+}
+
+/*!
+ * Change the synchronized input, keys typed in one terminal are sent
+ * to the other terminals of the tab or to all terminals.
+ *
+ * \param argument tab, all or off, toggle between off and tab if NULL
+ * \return TRUE if valid argument
+ */
+static gboolean set_sync_input(char* argument) {
+    if (argument == NULL) sync_input = sync_input == SCOPE_CURRENT ? SCOPE_TAB : SCOPE_CURRENT;
+    else if (strcmp(argument, "tab") == 0) sync_input = SCOPE_TAB;
+    else if (strcmp(argument, "all") == 0) sync_input = SCOPE_ALL;
+    else if (strcmp(argument, "off") == 0) sync_input = SCOPE_CURRENT;
+    else return FALSE;
+    print_line(LEVEL_INFO,"Synchronized input: %d", sync_input);
+    show_message("synchronized input %s", sync_input == SCOPE_ALL ? "all" : sync_input == SCOPE_TAB ? "tab" : "off");
+    return TRUE;
+}
+
+/*!
+ * Handle text typed in a terminal, repeat it to the other terminals
+ * when synchronized input is enabled.
+ *
+ * \param terminal
+ * \param text
+ * \param size
+ * \param user_data
+ */
+static void on_terminal_commit(VteTerminal *terminal, gchar *text, guint size, gpointer user_data) {
+    UNUSED(user_data);
+    if (sync_input == SCOPE_CURRENT || broadcasting || GTK_WIDGET(terminal) != current_terminal) return;
+    GList *terminals = get_scope_terminals(sync_input);
+    feed_terminals(terminals, text, size, GTK_WIDGET(terminal));
+    g_list_free(terminals);
+}
+
+/*!
+ * Compile a search regex, with JIT when available.
+ * The search is case insensitive unless the pattern has uppercase letters.
+ *
+ * \param pattern PCRE2 pattern
+ * \return regex or NULL if invalid, free with vte_regex_unref
+ */
+static VteRegex* compile_search_regex(const char *pattern) {
+    GError *error = NULL;
+    guint32 flags = PCRE2_UTF | PCRE2_MULTILINE;
+    gboolean upper = FALSE;
+    for (const char *c = pattern; *c != '\0' && !upper; c++) upper = isupper((unsigned char)*c);
+    if (!upper) flags |= PCRE2_CASELESS;
+    VteRegex *regex = vte_regex_new_for_search(pattern, -1, flags, &error);
+    if (regex == NULL) {
+        print_line(LEVEL_TRACE,"Invalid search regex %s: %s", pattern, error->message);
+        g_clear_error(&error);
+        return NULL;
+    }
+    if (!vte_regex_jit(regex, PCRE2_JIT_COMPLETE, &error)) {
+        print_line(LEVEL_TRACE,"Search regex without JIT: %s", error->message);
+        g_clear_error(&error);
+    }
+    return regex;
+}
+
+/*!
+ * Set the search regex of a terminal and select the last match,
+ * starting from the end of the scrollback.
+ * The match selection does not replace the clipboard with copy on selection,
+ * until the user starts a selection with the mouse.
+ *
+ * \param terminal
+ * \param regex search regex, NULL to clear the search
+ * \return TRUE if a match is found
+ */
+static gboolean search_terminal(GtkWidget *terminal, VteRegex *regex) {
+    vte_terminal_search_set_regex(VTE_TERMINAL(terminal), regex, 0);
+    vte_terminal_search_set_wrap_around(VTE_TERMINAL(terminal), TRUE);
+    g_object_set_data(G_OBJECT(terminal), "search_selection", GINT_TO_POINTER(regex != NULL));
+    vte_terminal_unselect_all(VTE_TERMINAL(terminal));
+    return regex != NULL && vte_terminal_search_find_previous(VTE_TERMINAL(terminal));
+}
+
+/*!
+ * Function for search in current terminal scrollback.
+ *
+ * \param argument <regex>, NULL to clear the search
+ * \return TRUE if valid regex
+ */
+static gboolean find(char *argument) {
+    print_line(LEVEL_INFO,"find");
+    if (current_terminal == NULL) return FALSE;
+    if (argument == NULL) {
+        search_terminal(current_terminal, NULL);
+        return TRUE;
+    }
+    VteRegex *regex = compile_search_regex(argument);
+    if (regex == NULL) return FALSE;
+    if (!search_terminal(current_terminal, regex)) print_line(LEVEL_TRACE,"No match for %s", argument);
+    vte_regex_unref(regex);
+    return TRUE;
+}
+
+/*!
+ * Timeout callback, search the find typed in the commander once typing pauses.
+ *
+ * \param user_data commander
+ * \return G_SOURCE_REMOVE
+ */
+static gboolean on_command_settled(gpointer user_data) {
+    GtkWidget *editable = user_data;
+    g_object_steal_data(G_OBJECT(editable), "search_id");
+    char *text = (char*)gtk_entry_get_text(GTK_ENTRY(editable));
+    if (current_terminal == NULL || get_function(text) != FUNCTION_FIND) return G_SOURCE_REMOVE;
+    char *pattern = get_function_argument(text);
+    if (pattern == NULL) return G_SOURCE_REMOVE;
+    VteRegex *regex = compile_search_regex(pattern);
+    if (regex == NULL) return G_SOURCE_REMOVE;
+    search_terminal(current_terminal, regex);
+    vte_regex_unref(regex);
+    return G_SOURCE_REMOVE;
+}
+
+/*!
+ * Commander text change, search incrementally while a find is typed.
+ * The search waits for a pause in typing, each change restarts the wait.
+ *
+ * \param editable commander
+ * \param user_data
+ */
+static void on_command_changed(GtkWidget *editable, gpointer user_data) {
+    UNUSED(user_data);
+    g_object_set_data(G_OBJECT(editable), "search_id", NULL);
+    char *text = (char*)gtk_entry_get_text(GTK_ENTRY(editable));
+    if (current_terminal == NULL || get_function(text) != FUNCTION_FIND) return;
+    guint source_id = g_timeout_add(SEARCH_SETTLE_DELAY, on_command_settled, editable);
+    g_object_set_data_full(G_OBJECT(editable), "search_id", GUINT_TO_POINTER(source_id), remove_source);
+}
+
+/*!
+ * Free the search across all panes, stop it if still running.
+ */
+static void stop_search_all() {
+    if (search_all == NULL) return;
+    if (search_all->source_id != 0) g_source_remove(search_all->source_id);
+    vte_regex_unref(search_all->regex);
+    g_list_free(search_all->ids);
+    g_string_free(search_all->found, TRUE);
+    g_free(search_all->pattern);
+    g_clear_pointer(&search_all, g_free);
+}
+
+/*!
+ * Idle callback, search the next pane.
+ * One pane is searched per main loop iteration so input is not blocked.
+ *
+ * \param user_data Search
+ * \return G_SOURCE_CONTINUE until all panes are searched
+ */
+static gboolean on_search_all_step(gpointer user_data) {
+    Search *search = user_data;
+    if (search->ids != NULL) {
+        guint id = GPOINTER_TO_UINT(search->ids->data);
+        search->ids = g_list_delete_link(search->ids, search->ids);
+        Pane *pane = g_hash_table_lookup(panes_by_id, GUINT_TO_POINTER(id));
+        if (pane != NULL && search_terminal(pane->terminal, search->regex)) {
+            print_line(LEVEL_TRACE,"Match in pane %u", id);
+            g_string_append_printf(search->found, " %u", id);
+            if (search->first == 0) search->first = id;
+        }
+        return G_SOURCE_CONTINUE;
+    }
+    search->source_id = 0;
+    Pane *pane = g_hash_table_lookup(panes_by_id, GUINT_TO_POINTER(search->first));
+    if (pane != NULL) {
+        GtkWidget *term_notebook = gtk_widget_get_parent(pane->tab);
+        gtk_notebook_set_current_page(GTK_NOTEBOOK(term_notebook), gtk_notebook_page_num(GTK_NOTEBOOK(term_notebook), pane->tab));
+        gtk_widget_grab_focus(pane->terminal);
+        current_terminal = pane->terminal;
+        show_message("%s found in panes%s", search->pattern, search->found->str);
+    } else {
+        show_message("%s not found", search->pattern);
+    }
+    stop_search_all();
+    return G_SOURCE_REMOVE;
+}
+
+/*!
+ * Function for search in the scrollback of all terminals, in background.
+ * The most recently used pane with a match is focused at the end.
+ *
+ * \param argument <regex>
+ * \return TRUE if valid regex
+ */
+static gboolean find_all(char *argument) {
+    print_line(LEVEL_INFO,"find_all");
+    if (argument == NULL) return FALSE;
+    VteRegex *regex = compile_search_regex(argument);
+    if (regex == NULL) return FALSE;
+    stop_search_all();
+    search_all = g_new0(Search, 1);
+    search_all->regex = regex;
+    search_all->pattern = g_strdup(argument);
+    search_all->found = g_string_new(NULL);
+    for (GList *link = pane_mru.tail; link != NULL; link = link->prev)
+        search_all->ids = g_list_prepend(search_all->ids, GUINT_TO_POINTER(((Pane*)link->data)->id));
+    search_all->source_id = g_idle_add_full(G_PRIORITY_LOW, on_search_all_step, search_all, NULL);
+    return TRUE;
+}
+
+/*!
+ * Wrap an output stream in a gzip compressor.
+ *
+ * \param out output stream, the reference is taken by the gzip stream
+ * \return gzip output stream
+ */
+static GOutputStream* new_gzip_stream(GOutputStream *out) {
+    GConverter *compressor = G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+    GOutputStream *gzip = g_converter_output_stream_new(out, compressor);
+    g_object_unref(compressor);
+    g_object_unref(out);
+    return gzip;
+}
+
+/*!
+ * Free an export, task data destroy notify.
+ *
+ * \param data Export
+ */
+static void free_export(gpointer data) {
+    Export *export = data;
+    if (export->terminal != NULL) g_object_remove_weak_pointer(G_OBJECT(export->terminal), (gpointer*)&export->terminal);
+    if (export->text != NULL) g_string_free(export->text, TRUE);
+    if (export->contents != NULL) g_bytes_unref(export->contents);
+    g_free(export->path);
+    g_free(export->command);
+    g_free(export);
+}
+
+/*!
+ * Worker thread, write the exported contents to the file, gzip
+ * compressed when the file name ends with .gz.
+ *
+ * \param task
+ * \param source_object
+ * \param task_data Export
+ * \param cancellable
+ */
+static void export_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    UNUSED(source_object);
+    Export *export = task_data;
+    GError *error = NULL;
+    GFile *file = g_file_new_for_path(export->path);
+    GOutputStream *out = G_OUTPUT_STREAM(g_file_replace(file, NULL, FALSE, G_FILE_CREATE_REPLACE_DESTINATION, cancellable, &error));
+    g_object_unref(file);
+    if (out != NULL && g_str_has_suffix(export->path, ".gz")) out = new_gzip_stream(out);
+    gsize size = 0;
+    gconstpointer contents = g_bytes_get_data(export->contents, &size);
+    gboolean written = out != NULL &&
+        g_output_stream_write_all(out, contents, size, NULL, cancellable, &error) &&
+        g_output_stream_close(out, cancellable, &error);
+    if (out != NULL) g_object_unref(out);
+    if (written) g_task_return_boolean(task, TRUE);
+    else g_task_return_error(task, error);
+}
+
+/*!
+ * Export completed, report it or open the command tab that reads it.
+ *
+ * \param source_object
+ * \param result
+ * \param user_data
+ */
+static void on_export_done(GObject *source_object, GAsyncResult *result, gpointer user_data) {
+    UNUSED(source_object);
+    UNUSED(user_data);
+    Export *export = g_task_get_task_data(G_TASK(result));
+    GError *error = NULL;
+    if (!g_task_propagate_boolean(G_TASK(result), &error)) {
+        print_line(LEVEL_ERROR,"Export to %s failed: %s", export->path, error->message);
+        show_message("export to %s failed: %s", export->path, error->message);
+        g_clear_error(&error);
+        if (export->command != NULL) g_unlink(export->path);
+        return;
+    }
+    print_line(LEVEL_INFO,"Exported %" G_GSIZE_FORMAT " bytes to %s", g_bytes_get_size(export->contents), export->path);
+    if (export->command == NULL) {
+        show_message("exported to %s", export->path);
+        return;
+    }
+    if (window == NULL) return;
+    char *quoted = g_shell_quote(export->path);
+    char *command = g_strdup_printf("%s < %s; rm -f %s", export->command, quoted, quoted);
+    GtkWidget *terminal = g_object_ref_sink(new_terminal(working_dir != NULL ? working_dir : (char*)g_get_home_dir(), command));
+    g_object_set_data(G_OBJECT(terminal), "transient", GINT_TO_POINTER(TRUE));
+    spawn_terminal(terminal);
+    add_tab(terminal);
+    g_free(command);
+    g_free(quoted);
+}
+
+/*!
+ * Idle callback, read the next rows of the exported terminal.
+ * The rows are read in chunks so a long scrollback does not block input,
+ * the file is written by a worker thread once all rows are read.
+ *
+ * \param user_data Export
+ * \return G_SOURCE_CONTINUE until all rows are read
+ */
+static gboolean on_export_step(gpointer user_data) {
+    Export *export = user_data;
+    if (export->terminal == NULL) {
+        print_line(LEVEL_ERROR,"Export to %s failed: terminal closed", export->path);
+        show_message("export to %s failed: terminal closed", export->path);
+        if (export->command != NULL) g_unlink(export->path);
+        free_export(export);
+        return G_SOURCE_REMOVE;
+    }
+    if (export->row <= export->end_row) {
+        VteTerminal *terminal = VTE_TERMINAL(export->terminal);
+        glong last = MIN(export->row + EXPORT_CHUNK_ROWS - 1, export->end_row);
+        char *text = vte_terminal_get_text_range(terminal, export->row, 0, last, vte_terminal_get_column_count(terminal) - 1, NULL, NULL, NULL);
+        if (text != NULL) {
+            g_string_append(export->text, text);
+            g_free(text);
+        }
+        export->row = last + 1;
+        return G_SOURCE_CONTINUE;
+    }
+    export->contents = g_string_free_to_bytes(export->text);
+    export->text = NULL;
+    g_object_remove_weak_pointer(G_OBJECT(export->terminal), (gpointer*)&export->terminal);
+    export->terminal = NULL;
+    print_line(LEVEL_TRACE,"Export %" G_GSIZE_FORMAT " bytes to %s", g_bytes_get_size(export->contents), export->path);
+    GTask *task = g_task_new(NULL, NULL, on_export_done, NULL);
+    g_task_set_task_data(task, export, free_export);
+    g_task_run_in_thread(task, export_thread);
+    g_object_unref(task);
+    return G_SOURCE_REMOVE;
+}
+
+/*!
+ * Function for export the current terminal contents, scrollback included.
+ * The contents are read on the main thread (VTE is not thread safe) a chunk
+ * of rows per iteration, the file is written and compressed by a worker thread.
+ *
+ * \param argument <path>, "| command" to read the contents with a command
+ *                 in a new tab, NULL for a file in the home directory
+ * \return TRUE if the export is started
+ */
+static gboolean export_contents(char *argument) {
+    print_line(LEVEL_INFO,"export_contents");
+    if (current_terminal == NULL) return FALSE;
+    Export *export = g_new0(Export, 1);
+    GError *error = NULL;
+    if (argument != NULL && argument[0] == '|') {
+        int fd = g_file_open_tmp(APP_NAME "-export-XXXXXX", &export->path, &error);
+        if (fd < 0) {
+            print_line(LEVEL_ERROR,"Unable to create export file: %s", error->message);
+            g_clear_error(&error);
+            free_export(export);
+            return FALSE;
+        }
+        g_close(fd, NULL);
+        export->command = g_strstrip(g_strdup(argument + 1));
+        if (*export->command == '\0') {
+            g_free(export->command);
+            export->command = g_strdup(g_getenv("PAGER") != NULL ? g_getenv("PAGER") : "less");
+        }
+    } else if (argument == NULL) {
+        GDateTime *now = g_date_time_new_now_local();
+        char *name = g_date_time_format(now, APP_NAME "-%Y%m%d-%H%M%S.txt");
+        export->path = g_build_filename(g_get_home_dir(), name, NULL);
+        g_free(name);
+        g_date_time_unref(now);
+    } else if (strncmp(argument, "~/", 2) == 0) {
+        export->path = g_build_filename(g_get_home_dir(), argument + 2, NULL);
+    } else if (!g_path_is_absolute(argument)) {
+        char *dir = get_terminal_directory(current_terminal);
+        export->path = g_build_filename(dir != NULL ? dir : g_get_home_dir(), argument, NULL);
+        g_free(dir);
+    } else {
+        export->path = g_strdup(argument);
+    }
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(current_terminal));
+    export->row = (glong)gtk_adjustment_get_lower(adjustment);
+    export->end_row = (glong)gtk_adjustment_get_upper(adjustment) - 1;
+    export->text = g_string_new(NULL);
+    export->terminal = current_terminal;
+    g_object_add_weak_pointer(G_OBJECT(export->terminal), (gpointer*)&export->terminal);
+    print_line(LEVEL_TRACE,"Export rows %ld to %ld to %s", export->row, export->end_row, export->path);
+    g_idle_add_full(G_PRIORITY_LOW, on_export_step, export, NULL);
+    return TRUE;
+}
+
+/*!
+ * Append text to the log ring buffer of a pane, main thread only.
+ * The ring is never waited on: text that does not fit is dropped and
+ * counted, the writer thread notes the loss in the log.
+ *
+ * \param logger
+ * \param text
+ * \param length
+ */
+static void log_append(Logger *logger, const char *text, guint length) {
+    guint head = logger->head;
+    guint space = LOG_RING_SIZE - (head - (guint)g_atomic_int_get(&logger->tail));
+    if (length > space) {
+        g_atomic_int_add(&logger->dropped, length - space);
+        length = space;
+    }
+    while (length > 0) {
+        guint index = head & (LOG_RING_SIZE - 1);
+        guint chunk = MIN(length, LOG_RING_SIZE - index);
+        memcpy(logger->ring + index, text, chunk);
+        text += chunk;
+        head += chunk;
+        length -= chunk;
+    }
+    g_atomic_int_set(&logger->head, head);
+}
+
+/*!
+ * Worker thread, compress a rotated log and remove it.
+ * The compression runs outside the writer thread so the pane logs are
+ * still drained while a large log is compressed.
+ *
+ * \param task
+ * \param source_object
+ * \param task_data rotated log and compressed file names
+ * \param cancellable
+ */
+static void compress_log(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
+    UNUSED(source_object);
+    UNUSED(cancellable);
+    char *path = ((char**)task_data)[0];
+    char *target = ((char**)task_data)[1];
+    GFile *source_file = g_file_new_for_path(path);
+    GFile *target_file = g_file_new_for_path(target);
+    GInputStream *in = G_INPUT_STREAM(g_file_read(source_file, NULL, NULL));
+    GOutputStream *out = G_OUTPUT_STREAM(g_file_replace(target_file, NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL, NULL));
+    if (in != NULL && out != NULL) {
+        out = new_gzip_stream(out);
+        if (g_output_stream_splice(out, in, G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE | G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET, NULL, NULL) >= 0)
+            g_unlink(path);
+    }
+    if (in != NULL) g_object_unref(in);
+    if (out != NULL) g_object_unref(out);
+    g_object_unref(source_file);
+    g_object_unref(target_file);
+    g_task_return_boolean(task, TRUE);
+}
+
+/*!
+ * Rotate a log that reached its maximum size, writer thread only.
+ * file.1 is the most recent rotated log, up to LOG_ROTATE_KEEP are kept.
+ *
+ * \param logger
+ */
+static void rotate_log(Logger *logger) {
+    char *suffix = logger->compress ? ".gz" : "";
+    fclose(logger->file);
+    logger->file = NULL;
+    logger->size = 0;
+    for (int i = LOG_ROTATE_KEEP - 1; i > 0; i--) {
+        char *from = g_strdup_printf("%s.%d%s", logger->path, i, suffix);
+        char *to = g_strdup_printf("%s.%d%s", logger->path, i + 1, suffix);
+        g_rename(from, to);
+        g_free(from);
+        g_free(to);
+    }
+    if (!logger->compress) {
+        char *rotated = g_strdup_printf("%s.1", logger->path);
+        g_rename(logger->path, rotated);
+        g_free(rotated);
+        return;
+    }
+    /* A unique name, the next rotation may come before the compression ends */
+    char **files = g_new0(char*, 3);
+    files[0] = g_strdup_printf("%s.rotated-%" G_GINT64_FORMAT, logger->path, g_get_monotonic_time());
+    files[1] = g_strdup_printf("%s.1.gz", logger->path);
+    g_rename(logger->path, files[0]);
+    GTask *task = g_task_new(NULL, NULL, NULL, NULL);
+    g_task_set_task_data(task, files, (GDestroyNotify)g_strfreev);
+    g_task_run_in_thread(task, compress_log);
+    g_object_unref(task);
+}
+
+/*!
+ * Write the buffered text of a pane to its log, writer thread only.
+ * The log is readable by the user only, it holds whatever the terminal shows.
+ *
+ * \param logger
+ */
+static void flush_log(Logger *logger) {
+    guint head = g_atomic_int_get(&logger->head);
+    guint tail = logger->tail;
+    gint dropped = g_atomic_int_get(&logger->dropped);
+    if (head == tail && dropped == 0) return;
+    if (logger->file == NULL) {
+        int fd = g_open(logger->path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+        if (fd >= 0 && (logger->file = fdopen(fd, "a")) == NULL) g_close(fd, NULL);
+        if (logger->file == NULL && !logger->failed) print_line(LEVEL_ERROR,"Unable to write log %s: %s", logger->path, g_strerror(errno));
+        logger->failed = logger->file == NULL;
+    }
+    if (logger->file == NULL) {
+        /* The text is lost, noted in the log when it can be written again */
+        g_atomic_int_add(&logger->dropped, head - tail);
+        g_atomic_int_set(&logger->tail, head);
+        return;
+    }
+    while (tail != head) {
+        guint index = tail & (LOG_RING_SIZE - 1);
+        guint chunk = MIN(head - tail, LOG_RING_SIZE - index);
+        logger->size += fwrite(logger->ring + index, 1, chunk, logger->file);
+        tail += chunk;
+    }
+    g_atomic_int_set(&logger->tail, tail);
+    if (dropped > 0) {
+        g_atomic_int_add(&logger->dropped, -dropped);
+        logger->size += fprintf(logger->file, "\n[ %d bytes lost, log buffer full or log not writable ]\n", dropped);
+    }
+    fflush(logger->file);
+    if (logger->max_size > 0 && logger->size >= logger->max_size) rotate_log(logger);
+}
+
+/*!
+ * Log writer thread, flush the logs of all panes every LOG_FLUSH_INTERVAL.
+ * New loggers arrive through log_queue, closed ones are flushed and freed.
+ *
+ * \param user_data
+ * \return NULL
+ */
+static gpointer log_writer(gpointer user_data) {
+    UNUSED(user_data);
+    GList *active = NULL;
+    gboolean stop = FALSE;
+    while (!stop || active != NULL) {
+        Logger *added = g_async_queue_timeout_pop(log_queue, LOG_FLUSH_INTERVAL);
+        if (added == &log_stop) stop = TRUE;
+        else if (added != NULL) active = g_list_prepend(active, added);
+        for (GList *item = active; item != NULL;) {
+            GList *next = item->next;
+            Logger *logger = item->data;
+            /* Read the flag first: nothing is appended once it is set */
+            gboolean closing = stop || g_atomic_int_get(&logger->closing);
+            flush_log(logger);
+            if (closing) {
+                if (logger->file != NULL) fclose(logger->file);
+                g_free(logger->path);
+                g_free(logger->ring);
+                g_free(logger);
+                active = g_list_delete_link(active, item);
+            }
+            item = next;
+        }
+    }
+    return NULL;
+}
+
+/*!
+ * Hand a logger back to the writer thread, destroy notify of terminal data.
+ *
+ * \param data Logger
+ */
+static void close_log(gpointer data) {
+    Logger *logger = data;
+    g_atomic_int_set(&logger->closing, TRUE);
+}
+
+/*!
+ * Append the rows above the cursor not logged yet, and the cursor row
+ * when the log is closing.
+ * Rows are logged once: rows redrawn above the last logged row (cursor
+ * movements, full screen applications) are not logged again.
+ *
+ * \param terminal
+ * \param logger
+ * \param cursor_row TRUE to log the cursor row too
+ */
+static void log_rows(VteTerminal *terminal, Logger *logger, gboolean cursor_row) {
+    glong column, row;
+    vte_terminal_get_cursor_position(terminal, &column, &row);
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal));
+    if (logger->row > (glong)gtk_adjustment_get_upper(adjustment)) {
+        /* Terminal reset with its history, follow the cursor */
+        logger->row = row;
+    }
+    glong last = cursor_row ? row : row - 1;
+    if (last < logger->row) return;
+    char *text = vte_terminal_get_text_range(terminal, logger->row, 0, last, vte_terminal_get_column_count(terminal) - 1, NULL, NULL, NULL);
+    if (text != NULL) {
+        log_append(logger, text, strlen(text));
+        g_free(text);
+    }
+    logger->row = last + 1;
+}
+
+/*!
+ * Terminal contents changed, append the lines completed since the last
+ * call to the log.
+ *
+ * \param terminal
+ * \param user_data Logger
+ */
+static void on_log_contents(VteTerminal *terminal, gpointer user_data) {
+    log_rows(terminal, user_data, FALSE);
+}
+
+/*!
+ * Stop the log of a terminal, the cursor row is logged before the log is
+ * handed back to the writer thread.
+ *
+ * \param terminal
+ * \param user_data
+ */
+static void finish_log(GtkWidget *terminal, gpointer user_data) {
+    UNUSED(user_data);
+    Logger *logger = g_object_steal_data(G_OBJECT(terminal), "logger");
+    if (logger == NULL) return;
+    print_line(LEVEL_INFO,"Stop log %s", logger->path);
+    g_signal_handlers_disconnect_by_func(terminal, on_log_contents, logger);
+    g_signal_handlers_disconnect_by_func(terminal, finish_log, NULL);
+    log_rows(VTE_TERMINAL(terminal), logger, TRUE);
+    close_log(logger);
+}
+
+/*!
+ * Start or stop the output log of a terminal.
+ *
+ * \param terminal
+ * \return TRUE if the log is started or stopped
+ */
+static gboolean toggle_log(GtkWidget *terminal) {
+    Logger *logger = g_object_get_data(G_OBJECT(terminal), "logger");
+    if (logger != NULL) {
+        finish_log(terminal, NULL);
+        return TRUE;
+    }
+    if (log_dir == NULL) return FALSE;
+    Pane *pane = get_pane(terminal);
+    char *dir = g_path_is_absolute(log_dir) ? g_strdup(log_dir) : g_build_filename(g_get_home_dir(), log_dir, NULL);
+    GDateTime *now = g_date_time_new_now_local();
+    char *date = g_date_time_format(now, "%Y%m%d-%H%M%S");
+    char *name = g_strdup_printf("%s-%s-%d-%u.log", APP_NAME, date, getpid(), pane != NULL ? pane->id : 0);
+    g_mkdir_with_parents(dir, 0700);
+    logger = g_new0(Logger, 1);
+    logger->path = g_build_filename(dir, name, NULL);
+    logger->ring = g_malloc(LOG_RING_SIZE);
+    logger->max_size = (gsize)log_max_mb * 1024 * 1024;
+    logger->compress = log_compress;
+    glong column;
+    vte_terminal_get_cursor_position(VTE_TERMINAL(terminal), &column, &logger->row);
+    g_free(name);
+    g_free(date);
+    g_date_time_unref(now);
+    g_free(dir);
+    print_line(LEVEL_INFO,"Start log %s", logger->path);
+    if (log_thread == NULL) {
+        log_queue = g_async_queue_new();
+        log_thread = g_thread_new("log writer", log_writer, NULL);
+    }
+    g_async_queue_push(log_queue, logger);
+    g_object_set_data_full(G_OBJECT(terminal), "logger", logger, close_log);
+    g_signal_connect(terminal, "contents-changed", G_CALLBACK(on_log_contents), logger);
+    g_signal_connect(terminal, "destroy", G_CALLBACK(finish_log), NULL);
+    return TRUE;
+}
+
+/*!
+ * Flush and close all logs, wait for the writer thread.
+ */
+static void stop_log_writer() {
+    if (log_thread == NULL) return;
+    GList *terminals = get_all_terminals();
+    /* The writer frees the loggers, terminals must not close them later */
+    for (GList *item = terminals; item != NULL; item = item->next) finish_log(item->data, NULL);
+    g_list_free(terminals);
+    g_async_queue_push(log_queue, &log_stop);
+    g_thread_join(log_thread);
+    log_thread = NULL;
+}
+
+/*!
+ * Function for go to specific page, show specific tab of notebook.
+ *
+ * \param argument <page number>
+ * \return TRUE if valid page or FALSE.
+ */
+static gboolean go_to(char* argument) {
+    print_line(LEVEL_INFO,"go_to");
+    if (argument == NULL) return FALSE;
+    print_line(LEVEL_TRACE,"Go to page %s", argument);
+    gint page_num = atoi(argument);
+    page_num--;
+    if (page_num >= 0 && page_num < gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook))) {
+        print_line(LEVEL_TRACE,"Page number int value: %d",page_num);
+        gtk_notebook_set_current_page(GTK_NOTEBOOK(notebook),page_num);
+        GtkWidget* page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook),page_num);
+        if (page == NULL || !focus_tab(page)) print_line(LEVEL_WARNING,"Valid terminal not found");
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*!
+ * Return all the terminals of all the windows.
+ *
+ * \return list of terminals, most recently focused first, free with g_list_free
+ */
+static GList* get_all_terminals() {
+    GList *terminals = NULL;
+    for (GList *link = pane_mru.tail; link != NULL; link = link->prev)
+        terminals = g_list_prepend(terminals, ((Pane*)link->data)->terminal);
+    return terminals;
+}
+
+/*!
+ * Show an informative message inside current terminal.
+ * The text is displayed only, it is not sent to the child process.
+ *
+ * \param format string and format specifiers
+ */
+static void show_message(char *format, ...) {
+    if (current_terminal == NULL) return;
+    va_list args;
+    va_start(args, format);
+    gchar *message = g_strdup_vprintf(format, args);
+    va_end(args);
+    gchar **lines = g_strsplit(message, "\n", -1);
+    gchar *text = g_strjoinv("\r\n", lines);
+    vte_terminal_feed(VTE_TERMINAL(current_terminal), "\r\n", -1);
+    vte_terminal_feed(VTE_TERMINAL(current_terminal), text, -1);
+    vte_terminal_feed(VTE_TERMINAL(current_terminal), "\r\n", -1);
+    g_free(text);
+    g_strfreev(lines);
+    g_free(message);
+}
+
+/*!
+ * Return the number of scrollback lines used by terminal, the screen rows
+ * are not counted as vte_terminal_set_scrollback_lines does not count them.
+ *
+ * \param terminal
+ * \return lines in scrollback
+ */
+static long get_scrollback_used(GtkWidget *terminal) {
+    GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(terminal));
+    if (adjustment == NULL) return 0;
+    long lines = (long)(gtk_adjustment_get_upper(adjustment) - gtk_adjustment_get_lower(adjustment));
+    return MAX(lines - vte_terminal_get_row_count(VTE_TERMINAL(terminal)), 0);
+}
+
+/*!
+ * Timeout callback, trim the oldest history of the least recently focused
+ * terminals until the estimated scrollback memory fits the budget.
+ * At least one screen of history is kept in every terminal.
+ *
+ * \param user_data
+ * \return G_SOURCE_CONTINUE while a budget is configured
+ */
+static gboolean on_scrollback_check(gpointer user_data) {
+    UNUSED(user_data);
+    if (scrollback_budget_mb <= 0) {
+        scrollback_check_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    gint64 budget = (gint64)scrollback_budget_mb * 1024 * 1024;
+    gint64 used = 0;
+    GList *terminals = g_list_reverse(get_all_terminals());
+    for (GList *item = terminals; item != NULL; item = item->next)
+        used += (gint64)get_scrollback_used(item->data) * vte_terminal_get_column_count(VTE_TERMINAL(item->data)) * TERM_SCROLLBACK_CELL_BYTES;
+    print_line(LEVEL_TRACE,"Scrollback memory: %ld of %ld bytes", (long)used, (long)budget);
+    for (GList *item = terminals; item != NULL && used > budget; item = item->next) {
+        VteTerminal *terminal = VTE_TERMINAL(item->data);
+        gint64 line_bytes = (gint64)vte_terminal_get_column_count(terminal) * TERM_SCROLLBACK_CELL_BYTES;
+        long lines = get_scrollback_used(item->data);
+        long keep = MAX(lines - (long)((used - budget) / line_bytes) - 1, vte_terminal_get_row_count(terminal));
+        if (keep >= lines) continue;
+        print_line(LEVEL_INFO,"Trim scrollback from %ld to %ld lines", lines, keep);
+        /* Shrinking the scrollback drops the oldest lines, then restore the limit */
+        vte_terminal_set_scrollback_lines(terminal, keep);
+        vte_terminal_set_scrollback_lines(terminal, scrollback_lines);
+        used -= (lines - keep) * line_bytes;
+    }
+    g_list_free(terminals);
+    return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * Start the periodic scrollback budget check when a budget is configured.
+ */
+static void check_scrollback_budget() {
+    if (scrollback_budget_mb > 0 && scrollback_check_id == 0)
+        scrollback_check_id = g_timeout_add_seconds(TERM_SCROLLBACK_CHECK_INTERVAL, on_scrollback_check, NULL);
+}
+
+/*!
+ * Return the resident memory of a process.
+ *
+ * \param process process id or "self" for microterm
+ * \return resident bytes, 0 if unknown
+ */
+static gint64 get_process_rss(const char *process) {
+    char *path = g_strdup_printf("/proc/%s/statm", process);
+    char *contents = NULL;
+    long size = 0, resident = 0;
+    if (g_file_get_contents(path, &contents, NULL, NULL)) sscanf(contents, "%ld %ld", &size, &resident);
+    g_free(contents);
+    g_free(path);
+    return (gint64)resident * sysconf(_SC_PAGESIZE);
+}
+
+/*!
+ * Count a widget and its children, internal children included.
+ *
+ * \param widget
+ * \param count widgets counted
+ */
+static void count_widgets(GtkWidget *widget, gpointer count) {
+    (*(guint*)count)++;
+    if (GTK_IS_CONTAINER(widget)) gtk_container_forall(GTK_CONTAINER(widget), count_widgets, count);
+}
+
+/*!
+ * Main loop poll function, count the wakeups for the stats.
+ *
+ * \param ufds
+ * \param nfsd
+ * \param timeout
+ * \return ready file descriptors
+ */
+static gint stats_poll(GPollFD *ufds, guint nfsd, gint timeout) {
+    stats_wakeups++;
+    return g_poll(ufds, nfsd, timeout);
+}
+
+/*!
+ * Return the resource report of every pane and of the process.
+ * Rates are measured since the previous report of the same consumer.
+ *
+ * \param consumer STATS_COMMAND, STATS_SIGNAL or STATS_TIMER
+ * \return report, free with g_free
+ */
+static char* get_stats_report(int consumer) {
+    GString *report = g_string_new(NULL);
+    StatsBaseline *baseline = &stats_baselines[consumer];
+    gint64 now = g_get_monotonic_time();
+    double elapsed = (now - baseline->time) / (double)G_USEC_PER_SEC;
+    GList *terminals = get_all_terminals();
+    for (GList *item = terminals; item != NULL; item = item->next) {
+        Pane *pane = get_pane(item->data);
+        VteTerminal *terminal = VTE_TERMINAL(item->data);
+        GPid pid = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(terminal), "pid"));
+        long lines = get_scrollback_used(item->data);
+        gint64 bytes = (gint64)lines * vte_terminal_get_column_count(terminal) * TERM_SCROLLBACK_CELL_BYTES;
+        glong column, row;
+        vte_terminal_get_cursor_position(terminal, &column, &row);
+        gint64 since = pane->stats_time[consumer];
+        /* The cursor row goes back after a terminal reset, no output is measured */
+        double rate = since > 0 ? MAX(row - pane->stats_row[consumer], 0) * G_USEC_PER_SEC / (double)MAX(now - since, 1) : 0;
+        pane->stats_row[consumer] = row;
+        pane->stats_time[consumer] = now;
+        g_string_append_printf(report, "pane %u: ", pane->id);
+        /* Terminals still spawning, not spawned yet or whose spawn failed have no child */
+        if (pid > 0) {
+            char *process = g_strdup_printf("%d", pid);
+            g_string_append_printf(report, "pid %d rss %.1f MB", pid, get_process_rss(process) / 1048576.0);
+            g_free(process);
+        } else {
+            g_string_append(report, "pid - rss -");
+        }
+        g_string_append_printf(report, ", scrollback %ld lines ~%.1f MB, output %.1f lines/s\n", lines, bytes / 1048576.0, rate);
+    }
+    guint widgets = 0;
+    GList *toplevels = gtk_window_list_toplevels();
+    for (GList *item = toplevels; item != NULL; item = item->next) count_widgets(item->data, &widgets);
+    g_list_free(toplevels);
+    g_string_append_printf(report, "process: rss %.1f MB, terminals %u (pool %u), widgets %u, wakeups %.1f/s\n",
+        get_process_rss("self") / 1048576.0, g_list_length(terminals), terminal_pool != NULL ? g_queue_get_length(terminal_pool) : 0,
+        widgets, baseline->time > 0 ? (stats_wakeups - baseline->wakeups) / MAX(elapsed, 0.001) : 0);
+    g_list_free(terminals);
+    baseline->time = now;
+    baseline->wakeups = stats_wakeups;
+    return g_string_free(report, FALSE);
+}
+
+/*!
+ * Print the stats report to stderr, SIGUSR1 handler and debug timer.
+ *
+ * \param user_data consumer, STATS_SIGNAL or STATS_TIMER
+ * \return G_SOURCE_CONTINUE
+ */
+static gboolean on_stats_dump(gpointer user_data) {
+    char *report = get_stats_report(GPOINTER_TO_INT(user_data));
+    fputs(report, stderr);
+    g_free(report);
+    return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * Start the stats sources: wakeup counter, SIGUSR1 dump and, with debug
+ * messages, a periodic dump.
+ */
+static void start_stats() {
+    g_main_context_set_poll_func(NULL, stats_poll);
+    gint64 now = g_get_monotonic_time();
+    for (int i = 0; i < STATS_CONSUMERS; i++) stats_baselines[i].time = now;
+    g_unix_signal_add(SIGUSR1, on_stats_dump, GINT_TO_POINTER(STATS_SIGNAL));
+    if (debug_mode) g_timeout_add_seconds(STATS_DEBUG_INTERVAL, on_stats_dump, GINT_TO_POINTER(STATS_TIMER));
+}
+
+/*!
+ * Show or change scrollback limits.
+ *
+ * \param argument [lines] [budget_mb]
+ * \return TRUE if valid values
+ */
+static gboolean set_scrollback(char* argument) {
+    print_line(LEVEL_INFO,"set_scrollback");
+    if (argument != NULL && sscanf(argument, "%ld %d", &scrollback_lines, &scrollback_budget_mb) > 0) {
+        print_line(LEVEL_TRACE,"Scrollback lines %ld, budget %d MB", scrollback_lines, scrollback_budget_mb);
+        /* New settings, so the terminals created later get the new limit too */
+        invalidate_render_settings();
+        RenderSettings *settings = get_render_settings();
+        GList *terminals = get_all_terminals();
+        if (terminal_pool != NULL)
+            for (GList *pooled = terminal_pool->head; pooled != NULL; pooled = pooled->next)
+                terminals = g_list_prepend(terminals, pooled->data);
+        for (GList *item = terminals; item != NULL; item = item->next)
+            update_terminal_settings(item->data, settings);
+        g_list_free(terminals);
+        check_scrollback_budget();
+    }
+    show_message("scrollback_lines %ld\nscrollback_budget_mb %d", scrollback_lines, scrollback_budget_mb);
+    return TRUE;
+}
+
+/*!
+ * Return the function argument, text after function name.
+ *
+ * \param function string with command
+ * \return pointer to argument inside function or NULL
+ */
+static char* get_function_argument(char* function) {
+    char* argument = strchr(function, ' ');
+    if (argument == NULL) return NULL;
+    while (*argument == ' ') argument++;
+    return *argument == '\0' ? NULL : argument;
+}
+
+/*!
+ * Parse string command and invoke correct function
+ *
+ * \param function string with command
+ * \return TRUE if command is valid.
+ */
+static gboolean execute_function(char* function) {
+    print_line(LEVEL_INFO,"execute_function");
+    return run_function(get_function(function), get_function_argument(function));
+}
+
+/*!
+ * Invoke function with already parsed argument
+ *
+ * \param function FUNCTION_* value
+ * \param argument function argument or NULL
+ * \return TRUE if command is valid.
+ */
+static gboolean run_function(int function, char* argument) {
+    print_line(LEVEL_INFO,"run_function");
+    switch (function) {
+        case FUNCTION_COPY:
+            vte_terminal_copy_clipboard_format(VTE_TERMINAL(current_terminal), VTE_FORMAT_TEXT);
+            return TRUE;
+        case FUNCTION_PASTE:
+            paste_clipboard(current_terminal);
+            return TRUE;
+        case FUNCTION_RELOAD:
+            return reload_settings();
+        case FUNCTION_QUIT:
+            close_window(window);
+            return TRUE;
+        case FUNCTION_FONT_INC:
+            zoom_font(1, FALSE);
+            return TRUE;
+        case FUNCTION_FONT_DEC:
+            zoom_font(-1, FALSE);
+            return TRUE;
+        case FUNCTION_FONT_RESET:
+            zoom_font(0, TRUE);
+            return TRUE;
+        case FUNCTION_SPLIT_V:
+            add_terminal_next_to(TRUE);
+            return TRUE;
+        case FUNCTION_SPLIT_H:
+            add_terminal_next_to(FALSE);
+            return TRUE;
+        case FUNCTION_NEW_TAB:
+            add_new_tab();
+            return TRUE;
+        case FUNCTION_PREV:
+            gtk_notebook_prev_page(GTK_NOTEBOOK(notebook));
+            return TRUE;
+        case FUNCTION_NEXT:
+            gtk_notebook_next_page(GTK_NOTEBOOK(notebook));
+            return TRUE;
+        case FUNCTION_CLOSE:
+            if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) > 1) {
+                gtk_notebook_remove_page(GTK_NOTEBOOK(notebook),gtk_notebook_get_current_page(GTK_NOTEBOOK(notebook)));
+                gtk_widget_queue_draw(GTK_WIDGET(notebook));
+            }
+            return TRUE;
+        case FUNCTION_EXEC:
+            return send_command_to_terminal(argument, SCOPE_CURRENT);
+        case FUNCTION_EXEC_TAB:
+            return send_command_to_terminal(argument, SCOPE_TAB);
+        case FUNCTION_EXEC_ALL:
+            return send_command_to_terminal(argument, SCOPE_ALL);
+        case FUNCTION_SYNC_INPUT:
+            return set_sync_input(argument);
+        case FUNCTION_GOTO:
+            return go_to(argument);
+        case FUNCTION_FIND:
+            return find(argument);
+        case FUNCTION_EXPORT:
+            return export_contents(argument);
+        case FUNCTION_TRACE:
+            return set_trace(argument);
+        case FUNCTION_STATS: {
+            char *report = get_stats_report(STATS_COMMAND);
+            show_message("%s", report);
+            g_free(report);
+            return TRUE;
+        }
+        case FUNCTION_LOG:
+            if (!toggle_log(current_terminal)) show_message("log disabled, set log_dir");
+            return TRUE;
+        case FUNCTION_FIND_ALL:
+            return find_all(argument);
+        case FUNCTION_FIND_NEXT:
+            vte_terminal_search_find_next(VTE_TERMINAL(current_terminal));
+            return TRUE;
+        case FUNCTION_FIND_PREV:
+            vte_terminal_search_find_previous(VTE_TERMINAL(current_terminal));
+            return TRUE;
+        case FUNCTION_SCROLLBACK:
+            return set_scrollback(argument);
+        case FUNCTION_COMMAND:
+            show_hide_commander();
+            return TRUE;
+        case FUNCTION_LATENCY:
+            if (!latency_mode) {
+                show_message("latency measure disabled, start with --latency");
+            } else {
+                char *report = get_latency_report();
+                show_message("%s", report);
+                g_free(report);
+            }
+            return TRUE;
+    }
+    return FALSE;
+}
+
+
+/*!
+ * Handle change on terminal title and propagate to window
+ *
+ * \param terminal
+ * \param user_data
+ * \return TRUE on title change, not continue
+ */
+static gboolean on_terminal_title_change(GtkWidget *terminal, gpointer user_data) {
+    UNUSED(user_data);
+    GtkWindow *window = GTK_WINDOW(gtk_widget_get_toplevel(terminal));
+    if (g_object_get_data(G_OBJECT(window), "notebook") == NULL) {
+        print_line(LEVEL_TRACE,"Terminal not in a window (pooled), ignore title");
+        return TRUE;
+    }
+    char *window_title = g_object_get_data(G_OBJECT(window), "title");
+    if (window_title == NULL)
+        gtk_window_set_title(window, vte_terminal_get_window_title(VTE_TERMINAL(terminal)) ?: "µterm");
+    else
+        gtk_window_set_title(window, window_title);
+    return TRUE;
+}
+
+/*!
+ * Handle add tab event
+ *
+ * \param notebook
+ * \param child
+ * \param page_num
+ * \param user_data
+ */
+static void on_tab_add(GtkNotebook *notebook, GtkWidget *child, guint page_num, gpointer user_data) {
+    print_line(LEVEL_INFO,"Add tab %d", page_num);
+    if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) > 1) {
+        print_line(LEVEL_TRACE,"Show tabs");
+        gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), TRUE);
+    }
+    /* Restored tabs stay hidden, so their shells are not spawned yet */
+    if (restoring_session) return;
+    gtk_notebook_set_current_page(GTK_NOTEBOOK(notebook), page_num);
+    if (!focus_tab(child) && gtk_widget_get_can_focus(child)) {
+        gtk_widget_grab_focus(child);
+    }
+}
+
+/*!
+ * Remove a pending timeout source, destroy notify of tab data.
+ *
+ * \param source_id
+ */
+static void remove_source(gpointer source_id) {
+    g_source_remove(GPOINTER_TO_UINT(source_id));
+}
+
+/*!
+ * Timeout callback, hibernate a tab hidden for hibernate_after seconds.
+ * The tab is unrealized so terminals release windows, render surfaces and
+ * font caches, while PTY and scrollback stay alive. When the tab is shown
+ * again GTK realizes it on map.
+ *
+ * \param user_data tab
+ * \return G_SOURCE_REMOVE
+ */
+static gboolean on_hibernate_tab(gpointer user_data) {
+    GtkWidget *tab = user_data;
+    g_object_steal_data(G_OBJECT(tab), "hibernate_id");
+    if (gtk_widget_get_mapped(tab) || !gtk_widget_get_realized(tab)) return G_SOURCE_REMOVE;
+    print_line(LEVEL_INFO,"Hibernate hidden tab");
+    gtk_widget_unrealize(tab);
+    return G_SOURCE_REMOVE;
+}
+
+/*!
+ * Handle switch tab event, schedule hibernation of the tab that is hidden.
+ *
+ * \param notebook
+ * \param page tab shown
+ * \param page_num
+ * \param user_data
+ */
+static void on_tab_switch(GtkNotebook *notebook, GtkWidget *page, guint page_num, gpointer user_data) {
+    UNUSED(page_num);
+    UNUSED(user_data);
+    /* Cancel pending hibernation of the tab shown */
+    g_object_set_data(G_OBJECT(page), "hibernate_id", NULL);
+    if (hibernate_after <= 0) return;
+    GtkWidget *hidden = gtk_notebook_get_nth_page(notebook, gtk_notebook_get_current_page(notebook));
+    if (hidden == NULL || hidden == page) return;
+    print_line(LEVEL_TRACE,"Schedule hibernation in %d seconds", hibernate_after);
+    guint source_id = g_timeout_add_seconds(hibernate_after, on_hibernate_tab, hidden);
+    g_object_set_data_full(G_OBJECT(hidden), "hibernate_id", GUINT_TO_POINTER(source_id), remove_source);
+}
+
+/*!
+ * Create the label of a notebook tab.
+ *
+ * \param number tab number, starting from 1
+ * \return label widget
+ */
+static GtkWidget* new_tab_label(int number) {
+    char text[16];
+    g_snprintf(text, sizeof(text), "%d", number);
+    return gtk_label_new(text);
+}
+
+/*!
+ * Handle delete tab event
+ *
+ * \param notebook
+ * \param child
+ * \param page_num
+ * \param user_data
+ */
+static void on_tab_del(GtkNotebook *notebook, GtkWidget *child, guint page_num, gpointer user_data) {
+    print_line(LEVEL_INFO,"Remove tab %d", page_num);
+    g_object_set_data(G_OBJECT(child), "hibernate_id", NULL);
+    gtk_widget_queue_draw(GTK_WIDGET(notebook));
+    if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) == 1) {
+        if (gtk_notebook_get_show_tabs(GTK_NOTEBOOK(notebook))) {
+            print_line(LEVEL_TRACE,"Hide tabs");
+            gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), FALSE);
+            gtk_widget_queue_draw(GTK_WIDGET(notebook));
+            GtkWidget* active_page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook),0);
+            gtk_notebook_set_tab_label(GTK_NOTEBOOK(notebook), active_page, new_tab_label(1));
+        }
+    } else if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) == 1) {
+        print_line(LEVEL_INFO,"Removed last page, quit");
+        close_window(gtk_widget_get_toplevel(GTK_WIDGET(notebook)));
+    } else {
+        print_line(LEVEL_TRACE,"Show tabs");
+        gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), TRUE);
+        gtk_widget_queue_draw(GTK_WIDGET(notebook));
+        if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) == page_num) {
+            print_line(LEVEL_TRACE, "removed last page nothing to do");
+        } else {
+            int pi;
+            for (pi=page_num;pi<gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook));pi++) {
+                gtk_notebook_set_tab_label(GTK_NOTEBOOK(notebook), gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook),pi), new_tab_label(pi+1));
+            }
+        }
+    }
+}
+
+/*!
+ * Set the terminal font to specified size.
+ *
+ * \param terminal
+ * \param font_size
+ */
+static void set_terminal_font(GtkWidget *terminal, int font_size) {
+    print_line(LEVEL_INFO,"Alter font to size: %d", font_size);
+    font_size = CLAMP(font_size, FONT_SIZE_MIN, FONT_SIZE_MAX);
+    vte_terminal_set_font(VTE_TERMINAL(terminal), get_font_description(get_render_settings(), font_size));
+    g_object_set_data(G_OBJECT(terminal), "font_size", GINT_TO_POINTER(font_size));
+}
+
+/*!
+ * Return the font description of a size, created once per size and
+ * shared by all the terminals.
+ *
+ * \param settings
+ * \param font_size
+ * \return font description, owned by settings
+ */
+static PangoFontDescription* get_font_description(RenderSettings *settings, int font_size) {
+    if (font_size == settings->font_size) return settings->font;
+    PangoFontDescription *font = g_hash_table_lookup(settings->fonts, GINT_TO_POINTER(font_size));
+    if (font == NULL) {
+        print_line(LEVEL_TRACE,"Create font description for size %d", font_size);
+        font = pango_font_description_copy(settings->font);
+        pango_font_description_set_size(font, font_size * PANGO_SCALE);
+        g_hash_table_insert(settings->fonts, GINT_TO_POINTER(font_size), font);
+    }
+    return font;
+}
+
+/*!
+ * Return the font size of the zoom target: the terminal or, for a
+ * window, the size last applied to it.
+ *
+ * \param target terminal or window
+ * \return font size
+ */
+static int get_zoom_size(GtkWidget *target) {
+    int size = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(target), "font_size"));
+    return size > 0 ? size : default_font_size;
+}
+
+/*!
+ * Apply the pending zoom. A window is zoomed with all its terminals
+ * resized in one frame, updates are frozen until every font is set.
+ *
+ * \param user_data
+ * \return G_SOURCE_REMOVE
+ */
+static gboolean on_zoom(gpointer user_data) {
+    UNUSED(user_data);
+    zoom_source = 0;
+    if (zoom_target == NULL) return G_SOURCE_REMOVE;
+    GtkWidget *target = zoom_target;
+    g_object_remove_weak_pointer(G_OBJECT(target), (gpointer*)&zoom_target);
+    zoom_target = NULL;
+    if (VTE_IS_TERMINAL(target)) {
+        if (get_zoom_size(target) != zoom_size) set_terminal_font(target, zoom_size);
+        return G_SOURCE_REMOVE;
+    }
+    print_line(LEVEL_TRACE,"Zoom window to size %d", zoom_size);
+    GdkWindow *gdk_window = gtk_widget_get_window(target);
+    if (gdk_window != NULL) gdk_window_freeze_updates(gdk_window);
+    GList *terminals = get_all_terminals();
+    for (GList *item = terminals; item != NULL; item = item->next) {
+        if (gtk_widget_get_toplevel(item->data) != target || get_zoom_size(item->data) == zoom_size) continue;
+        set_terminal_font(item->data, zoom_size);
+    }
+    g_list_free(terminals);
+    g_object_set_data(G_OBJECT(target), "font_size", GINT_TO_POINTER(zoom_size));
+    if (gdk_window != NULL) gdk_window_thaw_updates(gdk_window);
+    return G_SOURCE_REMOVE;
+}
+
+/*!
+ * Zoom the font of current terminal, or of its window with font_zoom window.
+ * Key repeat is coalesced: the size changes are accumulated and the fonts
+ * are set once the keys stop for ZOOM_SETTLE_DELAY.
+ *
+ * \param step size change
+ * \param reset TRUE to go back to the default size
+ */
+static void zoom_font(int step, gboolean reset) {
+    if (current_terminal == NULL) return;
+    GtkWidget *target = zoom_window ? gtk_widget_get_toplevel(current_terminal) : current_terminal;
+    if (zoom_source != 0) g_source_remove(zoom_source);
+    if (zoom_target != target) {
+        if (zoom_target != NULL) on_zoom(NULL);
+        zoom_target = target;
+        g_object_add_weak_pointer(G_OBJECT(target), (gpointer*)&zoom_target);
+        zoom_size = get_zoom_size(target);
+    }
+    zoom_size = reset ? default_font_size : CLAMP(zoom_size + step, FONT_SIZE_MIN, FONT_SIZE_MAX);
+    print_line(LEVEL_TRACE,"Pending zoom to size %d", zoom_size);
+    zoom_source = g_timeout_add(ZOOM_SETTLE_DELAY, on_zoom, NULL);
+}
+
+/*!
+ * Idle callback, rewrap one terminal per call after an interactive resize,
+ * so the main loop keeps running between panes.
+ * The terminal columns are set without rewrap to a different value and back
+ * with rewrap, VTE then rewraps the history once to the final width.
+ * The nudge resizes the pty, the program gets two extra SIGWINCH: it is done
+ * only for terminals whose width changed and with history to rewrap, the
+ * alternate screen of full screen programs has none.
+ * Rewrap is restored from the settings, a reload may have disabled it.
+ *
+ * \param user_data
+ * \return G_SOURCE_CONTINUE while terminals are waiting
+ */
+static gboolean rewrap_next_terminal(gpointer user_data) {
+    UNUSED(user_data);
+    GtkWidget *terminal = g_queue_pop_head(&resizing_terminals);
+    if (terminal == NULL) {
+        resize_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    glong columns = vte_terminal_get_column_count(VTE_TERMINAL(terminal));
+    glong rows = vte_terminal_get_row_count(VTE_TERMINAL(terminal));
+    glong start_columns = GPOINTER_TO_INT(g_object_steal_data(G_OBJECT(terminal), "resize_columns"));
+    if (get_pane(terminal) != NULL) {
+        gboolean rewrap = get_render_settings()->rewrap_on_resize;
+        gboolean resized = rewrap && columns != start_columns && columns > 1 && get_scrollback_used(terminal) > 0;
+        print_line(LEVEL_TRACE,"Rewrap pane %u from %ld to %ld columns", get_pane(terminal)->id, start_columns, columns);
+        if (resized) vte_terminal_set_size(VTE_TERMINAL(terminal), columns - 1, rows);
+        vte_terminal_set_rewrap_on_resize(VTE_TERMINAL(terminal), rewrap);
+        if (resized) vte_terminal_set_size(VTE_TERMINAL(terminal), columns, rows);
+    }
+    g_object_unref(terminal);
+    return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * Timeout callback, the interactive resize settled: rewrap the terminals,
+ * the visible ones first.
+ *
+ * \param user_data
+ * \return G_SOURCE_REMOVE
+ */
+static gboolean on_resize_settled(gpointer user_data) {
+    UNUSED(user_data);
+    print_line(LEVEL_TRACE,"Resize settled, rewrap %u terminals", g_queue_get_length(&resizing_terminals));
+    GQueue ordered = G_QUEUE_INIT;
+    GList *link;
+    while ((link = g_queue_pop_head_link(&resizing_terminals)) != NULL) {
+        if (gtk_widget_get_mapped(link->data)) g_queue_push_head_link(&ordered, link);
+        else g_queue_push_tail_link(&ordered, link);
+    }
+    resizing_terminals = ordered;
+    resize_source = g_idle_add(rewrap_next_terminal, NULL);
+    return G_SOURCE_REMOVE;
+}
+
+/*!
+ * An interactive resize of container is running: disable rewrap of its
+ * terminals until the size stops changing for RESIZE_SETTLE_DELAY, so the
+ * intermediate sizes do not rewrap the whole history each frame.
+ *
+ * \param container window or split
+ */
+static void defer_rewrap(GtkWidget *container) {
+    GList *terminals = get_all_terminals();
+    for (GList *item = terminals; item != NULL; item = item->next) {
+        GtkWidget *terminal = item->data;
+        if (!gtk_widget_is_ancestor(terminal, container) || !vte_terminal_get_rewrap_on_resize(VTE_TERMINAL(terminal))) continue;
+        g_object_set_data(G_OBJECT(terminal), "resize_columns", GINT_TO_POINTER(vte_terminal_get_column_count(VTE_TERMINAL(terminal))));
+        vte_terminal_set_rewrap_on_resize(VTE_TERMINAL(terminal), FALSE);
+        g_queue_push_tail(&resizing_terminals, g_object_ref(terminal));
+    }
+    g_list_free(terminals);
+    if (g_queue_is_empty(&resizing_terminals)) return;
+    if (resize_source != 0) g_source_remove(resize_source);
+    resize_source = g_timeout_add(RESIZE_SETTLE_DELAY, on_resize_settled, NULL);
+}
+
+/*!
+ * Handle split handle moves.
+ *
+ * \param paned
+ * \param pspec
+ * \param user_data
+ */
+static void on_split_moved(GtkWidget *paned, GParamSpec *pspec, gpointer user_data) {
+    UNUSED(pspec);
+    UNUSED(user_data);
+    GtkWidget *children[] = { gtk_paned_get_child1(GTK_PANED(paned)), gtk_paned_get_child2(GTK_PANED(paned)) };
+    for (gsize i = 0; i < G_N_ELEMENTS(children); i++) {
+        Pane *pane = children[i] != NULL && VTE_IS_TERMINAL(children[i]) ? get_pane(children[i]) : NULL;
+        if (pane != NULL) track_split(pane);
+    }
+    if (gtk_widget_get_mapped(paned)) defer_rewrap(paned);
+}
+
+/*!
+ * Handle window configure events, defer rewrap when the size changes.
+ *
+ * \param win
+ * \param event
+ * \param user_data
+ * \return FALSE, propagate event
+ */
+static gboolean on_window_configure(GtkWidget *win, GdkEventConfigure *event, gpointer user_data) {
+    UNUSED(user_data);
+    if (gtk_widget_get_mapped(win) &&
+            (event->width != gtk_widget_get_allocated_width(win) || event->height != gtk_widget_get_allocated_height(win)))
+        defer_rewrap(win);
+    return FALSE;
+}
+
+/*!
+ * Create a split container.
+ *
+ * \param orientation
+ * \return paned
+ */
+static GtkWidget* new_split(GtkOrientation orientation) {
+    GtkWidget *paned = gtk_paned_new(orientation);
+    g_signal_connect(paned, "notify::position", G_CALLBACK(on_split_moved), NULL);
+    return paned;
+}
+
+/*!
+ * Release a reference to render settings.
+ *
+ * \param settings
+ */
+static void render_settings_unref(RenderSettings *settings) {
+    if (!g_atomic_int_dec_and_test(&settings->ref_count)) return;
+    print_line(LEVEL_TRACE,"Free render settings");
+    g_hash_table_destroy(settings->fonts);
+    pango_font_description_free(settings->font);
+    g_free(settings->word_chars);
+    g_free(settings);
+}
+
+/*!
+ * Acquire a reference to render settings.
+ *
+ * \param settings
+ * \return settings
+ */
+static RenderSettings* render_settings_ref(RenderSettings *settings) {
+    g_atomic_int_inc(&settings->ref_count);
+    return settings;
+}
+
+/*!
+ * Return the render settings of current configuration, resolve palette,
+ * colors and font only the first time after configuration is parsed.
+ *
+ * \return settings, owned by the configuration
+ */
+static RenderSettings* get_render_settings() {
+    if (render_settings != NULL) return render_settings;
+    print_line(LEVEL_INFO,"Resolve render settings");
+    setlocale(LC_NUMERIC, term_locale);
+    RenderSettings *settings = g_new0(RenderSettings, 1);
+    settings->ref_count = 1;
+    for (int i = color_count; i < 256; i++) {
+        if (i < 16) {
+            term_palette[i].blue = (((i & 4) ? 0xc000 : 0) + (i > 7 ? 0x3fff : 0)) / 65535.0;
+            term_palette[i].green = (((i & 2) ? 0xc000 : 0) + (i > 7 ? 0x3fff : 0)) / 65535.0;
+            term_palette[i].red = (((i & 1) ? 0xc000 : 0) + (i > 7 ? 0x3fff : 0)) / 65535.0;
+            term_palette[i].alpha = 0;
+        } else if (i < 232) {
+            const unsigned j = i - 16;
+            const unsigned r = j / 36, g = (j / 6) % 6, b = j % 6;
+            term_palette[i].red = ((r == 0) ? 0 : r * 40 + 55) / 255.0;
+            term_palette[i].green = ((g == 0) ? 0 : g * 40 + 55) / 255.0;
+            term_palette[i].blue = ((b == 0) ? 0 : b * 40 + 55) / 255.0;
+            term_palette[i].alpha = 0;
+        } else if (i < 256) {
+            const unsigned shade = 8 + (i - 232) * 10;
+            term_palette[i].red = term_palette[i].green =
+                term_palette[i].blue = (shade | shade << 8) / 65535.0;
+            term_palette[i].alpha = 0;
+        }
+    }
+    memcpy(settings->palette, term_palette, sizeof(term_palette));
+    settings->foreground = CLR_GDK(term_foreground, 0);
+    settings->background = CLR_GDK(term_background, term_opacity);
+    settings->bold = CLR_GDK(term_bold_color, 0);
+    settings->cursor = CLR_GDK(term_cursor_color, 0);
+    settings->cursor_foreground = CLR_GDK(term_cursor_foreground, 0);
+    settings->cursor_shape = term_cursor_shape;
+    settings->font_size = default_font_size;
+    char *font_str = g_strdup_printf("%s %d", term_font, default_font_size);
+    settings->font = pango_font_description_from_string(font_str);
+    settings->fonts = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)pango_font_description_free);
+    g_free(font_str);
+    settings->word_chars = g_strdup(term_word_chars);
+    settings->scrollback_lines = scrollback_lines;
+    settings->rewrap_on_resize = rewrap_on_resize;
+    render_settings = settings;
+    return render_settings;
+}
+
+/*!
+ * Forget current render settings after configuration change, terminals
+ * keep their reference until new settings are applied.
+ */
+static void invalidate_render_settings() {
+    g_clear_pointer(&render_settings, render_settings_unref);
+}
+
+/*!
+ * Update the terminal color palette.
+ *
+ * \param terminal
+ * \param settings
+ */
+static void set_terminal_colors(GtkWidget *terminal, RenderSettings *settings) {
+    print_line(LEVEL_INFO,"Set terminal colors");
+    /* terminal, foreground, background, palette */
+    vte_terminal_set_colors(VTE_TERMINAL(terminal), &settings->foreground, &settings->background, settings->palette, TERM_PALETTE_SIZE);
+    vte_terminal_set_color_bold(VTE_TERMINAL(terminal), &settings->bold);
+}
+
+/*!
+ * Apply terminal settings.
+ *
+ * \param terminal
+ */
+static void apply_terminal_settings(GtkWidget *terminal) {
+    RenderSettings *settings = get_render_settings();
+    vte_terminal_set_mouse_autohide(VTE_TERMINAL(terminal), TRUE);
+    vte_terminal_set_scroll_on_output(VTE_TERMINAL(terminal), FALSE);
+    vte_terminal_set_scroll_on_keystroke(VTE_TERMINAL(terminal), TRUE);
+    vte_terminal_set_scrollback_lines(VTE_TERMINAL(terminal), settings->scrollback_lines);
+    vte_terminal_set_rewrap_on_resize(VTE_TERMINAL(terminal), settings->rewrap_on_resize);
+    vte_terminal_set_audible_bell(VTE_TERMINAL(terminal), FALSE);
+    vte_terminal_set_allow_bold(VTE_TERMINAL(terminal), TRUE);
+    vte_terminal_set_allow_hyperlink(VTE_TERMINAL(terminal), TRUE);
+    vte_terminal_set_word_char_exceptions(VTE_TERMINAL(terminal), settings->word_chars);
+    vte_terminal_set_cursor_blink_mode(VTE_TERMINAL(terminal), VTE_CURSOR_BLINK_OFF);
+    vte_terminal_set_color_cursor(VTE_TERMINAL(terminal), &settings->cursor);
+    vte_terminal_set_color_cursor_foreground(VTE_TERMINAL(terminal), &settings->cursor_foreground);
+    vte_terminal_set_cursor_shape(VTE_TERMINAL(terminal), settings->cursor_shape);
+    set_terminal_colors(terminal, settings);
+    set_terminal_font(terminal, settings->font_size);
+    g_object_set_data_full(G_OBJECT(terminal), "render_settings", render_settings_ref(settings), (GDestroyNotify)render_settings_unref);
+}
+
+/*!
+ * Apply to terminal only the settings changed from the ones it has.
+ *
+ * \param terminal
+ * \param settings new render settings
+ */
+static void update_terminal_settings(GtkWidget *terminal, RenderSettings *settings) {
+    RenderSettings *old = g_object_get_data(G_OBJECT(terminal), "render_settings");
+    if (old == NULL) {
+        apply_terminal_settings(terminal);
+        return;
+    }
+    if (old == settings) return;
+    if (memcmp(old->palette, settings->palette, sizeof(settings->palette)) != 0 ||
+            !gdk_rgba_equal(&old->foreground, &settings->foreground) ||
+            !gdk_rgba_equal(&old->background, &settings->background) ||
+            !gdk_rgba_equal(&old->bold, &settings->bold))
+        set_terminal_colors(terminal, settings);
+    if (!gdk_rgba_equal(&old->cursor, &settings->cursor))
+        vte_terminal_set_color_cursor(VTE_TERMINAL(terminal), &settings->cursor);
+    if (!gdk_rgba_equal(&old->cursor_foreground, &settings->cursor_foreground))
+        vte_terminal_set_color_cursor_foreground(VTE_TERMINAL(terminal), &settings->cursor_foreground);
+    if (old->cursor_shape != settings->cursor_shape)
+        vte_terminal_set_cursor_shape(VTE_TERMINAL(terminal), settings->cursor_shape);
+    if (g_strcmp0(old->word_chars, settings->word_chars) != 0)
+        vte_terminal_set_word_char_exceptions(VTE_TERMINAL(terminal), settings->word_chars);
+    if (old->scrollback_lines != settings->scrollback_lines)
+        vte_terminal_set_scrollback_lines(VTE_TERMINAL(terminal), settings->scrollback_lines);
+    if (old->rewrap_on_resize != settings->rewrap_on_resize)
+        vte_terminal_set_rewrap_on_resize(VTE_TERMINAL(terminal), settings->rewrap_on_resize);
+    if (old->font_size != settings->font_size || !pango_font_description_equal(old->font, settings->font))
+        set_terminal_font(terminal, settings->font_size);
+    g_object_set_data_full(G_OBJECT(terminal), "render_settings", render_settings_ref(settings), (GDestroyNotify)render_settings_unref);
+}
+
+/*!
+ * Parse the configuration file, the default one or the one given with -c.
+ * The palette is cleared first, the colors not set are filled with the
+ * default palette when the render settings are resolved.
+ *
+ * \return FALSE if the file or an included one can't be read
+ */
+static gboolean load_settings() {
+    color_count = 0;
+    memset(term_palette, 0, sizeof(term_palette));
+    if (!default_config_file) return parse_settings(config_file_name);
+    char *default_file = get_default_config_file_name();
+    gboolean parsed = parse_settings(default_file);
+    g_free(default_file);
+    return parsed;
+}
+
+/*!
+ * Save the settings read from configuration, the strings are copied.
+ *
+ * \param snapshot
+ */
+static void save_config(ConfigSnapshot *snapshot) {
+    snapshot->term_opacity = term_opacity;
+    snapshot->term_background = term_background;
+    snapshot->term_foreground = term_foreground;
+    snapshot->term_bold_color = term_bold_color;
+    snapshot->term_cursor_color = term_cursor_color;
+    snapshot->term_cursor_foreground = term_cursor_foreground;
+    snapshot->term_cursor_shape = term_cursor_shape;
+    snapshot->default_font_size = default_font_size;
+    memcpy(snapshot->term_palette, term_palette, sizeof(term_palette));
+    snapshot->color_count = color_count;
+    snapshot->tab_position = tab_position;
+    snapshot->commander_position = commander_position;
+    snapshot->zoom_window = zoom_window;
+    snapshot->focus_follow_mouse = focus_follow_mouse;
+    snapshot->copy_on_selection = copy_on_selection;
+    snapshot->rewrap_on_resize = rewrap_on_resize;
+    snapshot->watch_config = watch_config;
+    snapshot->log_max_mb = log_max_mb;
+    snapshot->log_compress = log_compress;
+    snapshot->log_all = log_all;
+    snapshot->hibernate_after = hibernate_after;
+    snapshot->pool_size = pool_size;
+    snapshot->scrollback_lines = scrollback_lines;
+    snapshot->scrollback_budget_mb = scrollback_budget_mb;
+    snapshot->font_value = g_strdup(font_value);
+    snapshot->locale_value = g_strdup(locale_value);
+    snapshot->word_chars = g_strdup(word_chars);
+    snapshot->log_dir = g_strdup(log_dir);
+    snapshot->control_socket = g_strdup(control_socket);
+}
+
+/*!
+ * Free the strings of a snapshot no longer needed.
+ *
+ * \param snapshot
+ */
+static void release_config(ConfigSnapshot *snapshot) {
+    g_free(snapshot->font_value);
+    g_free(snapshot->locale_value);
+    g_free(snapshot->word_chars);
+    g_free(snapshot->log_dir);
+    g_free(snapshot->control_socket);
+}
+
+/*!
+ * Put back the settings of a snapshot, the snapshot strings are taken.
+ *
+ * \param snapshot
+ */
+static void restore_config(ConfigSnapshot *snapshot) {
+    term_opacity = snapshot->term_opacity;
+    term_background = snapshot->term_background;
+    term_foreground = snapshot->term_foreground;
+    term_bold_color = snapshot->term_bold_color;
+    term_cursor_color = snapshot->term_cursor_color;
+    term_cursor_foreground = snapshot->term_cursor_foreground;
+    term_cursor_shape = snapshot->term_cursor_shape;
+    default_font_size = snapshot->default_font_size;
+    memcpy(term_palette, snapshot->term_palette, sizeof(term_palette));
+    color_count = snapshot->color_count;
+    tab_position = snapshot->tab_position;
+    commander_position = snapshot->commander_position;
+    zoom_window = snapshot->zoom_window;
+    focus_follow_mouse = snapshot->focus_follow_mouse;
+    copy_on_selection = snapshot->copy_on_selection;
+    rewrap_on_resize = snapshot->rewrap_on_resize;
+    watch_config = snapshot->watch_config;
+    log_max_mb = snapshot->log_max_mb;
+    log_compress = snapshot->log_compress;
+    log_all = snapshot->log_all;
+    hibernate_after = snapshot->hibernate_after;
+    pool_size = snapshot->pool_size;
+    scrollback_lines = snapshot->scrollback_lines;
+    scrollback_budget_mb = snapshot->scrollback_budget_mb;
+    g_free(font_value);
+    g_free(locale_value);
+    g_free(word_chars);
+    g_free(log_dir);
+    g_free(control_socket);
+    font_value = snapshot->font_value;
+    locale_value = snapshot->locale_value;
+    word_chars = snapshot->word_chars;
+    log_dir = snapshot->log_dir;
+    control_socket = snapshot->control_socket;
+    term_font = font_value != NULL ? font_value : TERM_FONT;
+    term_locale = locale_value != NULL ? locale_value : TERM_LOCALE;
+    term_word_chars = word_chars != NULL ? word_chars + 1 : TERM_WORD_CHARS;
+}
+
+/*!
+ * Reload configuration and apply the changed settings to every terminal
+ * of every window, window updates are frozen so all the changes are
+ * painted together.
+ */
+static gboolean reload_settings() {
+    print_line(LEVEL_INFO,"Reload settings");
+    GHashTable *old_hotkeys = hotkeys;
+    GPtrArray *old_config_files = config_files;
+    gboolean parsed;
+    /* Parse into new tables, the current ones are kept if the file can't be read */
+    ConfigSnapshot snapshot;
+    save_config(&snapshot);
+    hotkeys = new_hotkey_table();
+    config_files = NULL;
+    parsed = load_settings();
+    if (parsed && g_hash_table_size(hotkeys) == 0 && g_hash_table_size(old_hotkeys) > 0) {
+        /* A file truncated while written would drop every hotkey, reload included */
+        print_line(LEVEL_ERROR,"No hotkey in configuration, keep the current one");
+        parsed = FALSE;
+    }
+    if (!parsed) {
+        print_line(LEVEL_ERROR,"Reload failed, keep current settings");
+        g_hash_table_destroy(hotkeys);
+        if (config_files != NULL) g_ptr_array_free(config_files, TRUE);
+        hotkeys = old_hotkeys;
+        config_files = old_config_files;
+        restore_config(&snapshot);
+        return FALSE;
+    }
+    if (g_strcmp0(snapshot.control_socket, control_socket) != 0) {
+        stop_control_socket();
+        start_control_socket();
+    }
+    release_config(&snapshot);
+    chord = NULL;
+    g_hash_table_destroy(old_hotkeys);
+    if (old_config_files != NULL) g_ptr_array_free(old_config_files, TRUE);
+    RenderSettings *old = render_settings_ref(get_render_settings());
+    invalidate_render_settings();
+    RenderSettings *settings = get_render_settings();
+    /* A new font resets the window zoom, its terminals get the configured size */
+    gboolean font_changed = old->font_size != settings->font_size || !pango_font_description_equal(old->font, settings->font);
+    render_settings_unref(old);
+    GList *toplevels = gtk_window_list_toplevels();
+    for (GList *item = toplevels; item != NULL; item = item->next) {
+        if (g_object_get_data(G_OBJECT(item->data), "notebook") == NULL) continue;
+        if (font_changed) g_object_set_data(G_OBJECT(item->data), "font_size", NULL);
+        if (gtk_widget_get_window(item->data) == NULL) continue;
+        gdk_window_freeze_updates(gtk_widget_get_window(item->data));
+        gtk_widget_override_background_color(item->data, GTK_STATE_FLAG_NORMAL, &settings->background);
+    }
+    GList *terminals = get_all_terminals();
+    if (terminal_pool != NULL)
+        for (GList *pooled = terminal_pool->head; pooled != NULL; pooled = pooled->next)
+            terminals = g_list_prepend(terminals, pooled->data);
+    print_line(LEVEL_TRACE,"Update %d terminals", g_list_length(terminals));
+    for (GList *item = terminals; item != NULL; item = item->next)
+        update_terminal_settings(item->data, settings);
+    g_list_free(terminals);
+    for (GList *item = toplevels; item != NULL; item = item->next) {
+        if (g_object_get_data(G_OBJECT(item->data), "notebook") == NULL || gtk_widget_get_window(item->data) == NULL) continue;
+        gdk_window_thaw_updates(gtk_widget_get_window(item->data));
+    }
+    g_list_free(toplevels);
+    check_scrollback_budget();
+    watch_config_files();
+    return TRUE;
+}
+
+/*!
+ * Timeout callback, automatic reload after configuration change.
+ *
+ * \param user_data
+ * \return G_SOURCE_REMOVE
+ */
+static gboolean on_config_reload(gpointer user_data) {
+    UNUSED(user_data);
+    config_reload_id = 0;
+    if (!reload_settings()) print_line(LEVEL_WARNING,"Automatic reload ignored, configuration not valid");
+    return G_SOURCE_REMOVE;
+}
+
+/*!
+ * Handle change of a configuration file. Editors save in several steps:
+ * the reload is armed only when a write is complete (changes done, file
+ * created or moved in place) and every following event restarts the
+ * interval, so the reload runs once after the last event of the burst.
+ *
+ * \param monitor
+ * \param file
+ * \param other_file
+ * \param event_type
+ * \param user_data
+ */
+static void on_config_changed(GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event_type, gpointer user_data) {
+    UNUSED(monitor);
+    UNUSED(file);
+    UNUSED(other_file);
+    UNUSED(user_data);
+    if (event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED) return;
+    print_line(LEVEL_TRACE,"Configuration file changed (%d)", event_type);
+    gboolean complete = event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT || event_type == G_FILE_MONITOR_EVENT_CREATED ||
+        event_type == G_FILE_MONITOR_EVENT_RENAMED || event_type == G_FILE_MONITOR_EVENT_MOVED_IN;
+    /* A write in progress only delays a pending reload */
+    if (!complete && config_reload_id == 0) return;
+    if (config_reload_id != 0) g_source_remove(config_reload_id);
+    config_reload_id = g_timeout_add(CONFIG_WATCH_INTERVAL, on_config_reload, NULL);
+}
+
+/*!
+ * Watch the configuration file and all the included files, the monitors
+ * are recreated because includes can change after a reload.
+ */
+static void watch_config_files() {
+    g_list_free_full(config_monitors, g_object_unref);
+    config_monitors = NULL;
+    if (!watch_config || config_files == NULL) return;
+    for (guint i = 0; i < config_files->len; i++) {
+        GFile *file = g_file_new_for_path(g_ptr_array_index(config_files, i));
+        GFileMonitor *monitor = g_file_monitor_file(file, G_FILE_MONITOR_WATCH_MOVES, NULL, NULL);
+        g_object_unref(file);
+        if (monitor == NULL) {
+            print_line(LEVEL_WARNING,"Unable to watch %s", (char*)g_ptr_array_index(config_files, i));
+            continue;
+        }
+        print_line(LEVEL_TRACE,"Watch %s", (char*)g_ptr_array_index(config_files, i));
+        g_signal_connect(monitor, "changed", G_CALLBACK(on_config_changed), NULL);
+        config_monitors = g_list_prepend(config_monitors, monitor);
+    }
+}
+
+/*!
+ * Async terminal callback.
+ *
+ * \param terminal
+ * \param pid (Process ID)
+ * \param error
+ * \param user_data
+ */
+static void terminal_callback(VteTerminal *terminal, GPid pid, GError *error, gpointer user_data) {
+    if (error == NULL) {
+        print_line(LEVEL_INFO,"µterm successfully started. (PID: %d)", pid);
+        g_object_set_data(G_OBJECT(terminal), "pid", GINT_TO_POINTER(pid));
+        profile_mark("child_spawned");
+    } else {
+        print_line(LEVEL_SEVERE,"Error starting terminal: %s", error->message);
+        g_clear_error(&error);
+    }
+    UNUSED(user_data);
+}
+
+
+/*!
+ * Add a new tab to notebook
+ */
+static void add_new_tab() {
+    add_tab(take_terminal());
+}
+
+/*!
+ * Add a tab with a terminal to notebook
+ *
+ * \param new_term terminal, the reference of the caller is taken
+ */
+static void add_tab(GtkWidget *new_term) {
+    print_line(LEVEL_INFO,"Add new tab");
+    GtkWidget *box = new_split(GTK_ORIENTATION_VERTICAL);
+    gtk_widget_show(new_term);
+    gtk_widget_show(box);
+    gtk_paned_pack1(GTK_PANED(box), new_term, TRUE, TRUE);
+    g_object_unref(new_term);
+    register_pane(new_term, box);
+    GtkWidget *label = new_tab_label(gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) + 1);
+    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), box, label);
+    if (gtk_widget_get_can_focus(new_term)) {
+        gtk_widget_grab_focus(new_term);
+        current_terminal = new_term;
+    }
+}
+
+/*!
+ * Add terminal next to another terminal
+ *
+ * \param vertical (true or false for horizontal)
+ */
+static void add_terminal_next_to(gboolean vertical) {
+    print_line(LEVEL_INFO,"Add terminal next to current");
+    if (current_terminal == NULL) return;
+    GtkWidget *parent = gtk_widget_get_parent(current_terminal);
+    GtkWidget *new_term = take_terminal();
+    GtkWidget *box;
+    print_line(LEVEL_TRACE,"Current page: %d",gtk_notebook_get_current_page(GTK_NOTEBOOK(notebook)));
+    if (vertical) {
+        print_line(LEVEL_TRACE,"Create vertical container");
+        box = new_split(GTK_ORIENTATION_VERTICAL);
+    } else {
+        print_line(LEVEL_TRACE,"Create horizontal container");
+        box = new_split(GTK_ORIENTATION_HORIZONTAL);
+    }
+    g_object_ref(current_terminal);
+    if (GTK_IS_NOTEBOOK(parent)) {
+        print_line(LEVEL_TRACE,"Remove terminal from notebook");
+        gtk_container_remove(GTK_CONTAINER(parent), current_terminal);
+        print_line(LEVEL_TRACE, "Add the box to notebook");
+        gtk_container_add(GTK_CONTAINER(parent), box);
+    } else if (GTK_IS_PANED(parent)) {
+        gboolean first = gtk_paned_get_child1(GTK_PANED(parent)) == current_terminal;
+        gtk_container_remove (GTK_CONTAINER(parent), current_terminal);
+        if (first) {
+            print_line(LEVEL_TRACE,"Box at start");
+            gtk_paned_pack1(GTK_PANED(parent), box, TRUE, TRUE);
+        } else {
+            print_line(LEVEL_TRACE,"Box at end");
+            gtk_paned_pack2(GTK_PANED(parent), box, TRUE, TRUE);
+        }
+    } else {
+        print_line(LEVEL_ERROR,"Unexpected");
+    }
+    gtk_paned_set_wide_handle (GTK_PANED(box),TRUE);
+    print_line(LEVEL_TRACE,"Add old terminal");
+    gtk_paned_pack1(GTK_PANED(box), current_terminal, TRUE, TRUE);
+    g_object_unref(current_terminal);
+    print_line(LEVEL_TRACE,"Add new_terminal at end");
+    gtk_paned_pack2(GTK_PANED(box), new_term, TRUE, TRUE);
+    g_object_unref(new_term);
+    track_split(get_pane(current_terminal));
+    register_pane(new_term, get_pane(current_terminal)->tab);
+    gtk_widget_show_all(box);
+    print_line(LEVEL_TRACE,"Set focus to new terminal");
+    gtk_widget_grab_focus(new_term);
+    current_terminal = new_term;
+}
+
+/*!
+ * Create a new terminal widget.
+ *
+ * \return terminal (GtkWidget)
+ */
+static GtkWidget* create_terminal() {
+    if (working_dir == NULL) {
+        working_dir = g_get_current_dir();
+        print_line(LEVEL_TRACE, "Set default working_dir: %s", working_dir);
+    }
+    GtkWidget *terminal = new_terminal(working_dir, term_command);
+    spawn_terminal(terminal);
+    return terminal;
+}
+
+/*!
+ * Create and configure a new terminal without spawning its shell.
+ * The working directory and command are stored on the terminal for
+ * spawn_terminal, the pool and the session.
+ *
+ * \param dir working directory
+ * \param cmd command to execute, NULL for the shell
+ * \return terminal (GtkWidget)
+ */
+static GtkWidget* new_terminal(char *dir, char *cmd) {
+    print_line(LEVEL_INFO,"Create new terminal");
+    GtkWidget *terminal = vte_terminal_new();
+    print_line(LEVEL_TRACE,"Connect signals to terminal");
+    g_signal_connect(terminal, "child-exited", G_CALLBACK(on_terminal_exit), NULL);
+    g_signal_connect(terminal, "key-press-event", G_CALLBACK(on_hotkey), NULL);
+    g_signal_connect(terminal, "window-title-changed", G_CALLBACK(on_terminal_title_change), NULL);
+    g_signal_connect(terminal, "selection-changed", G_CALLBACK(on_terminal_selection), NULL);
+    g_signal_connect(terminal, "button-press-event", G_CALLBACK(on_terminal_button), NULL);
+    g_signal_connect(terminal, "button-release-event", G_CALLBACK(on_terminal_button), NULL);
+    g_signal_connect(terminal, "focus-in-event", G_CALLBACK(has_focus), NULL);
+    g_signal_connect(terminal, "motion-notify-event",G_CALLBACK(focus_change),NULL);
+    g_signal_connect(terminal, "commit", G_CALLBACK(on_terminal_commit), NULL);
+    if (latency_mode) {
+        g_object_set_data_full(G_OBJECT(terminal), "latency", g_new0(LatencyStats, 1), free_latency_stats);
+        g_signal_connect(terminal, "commit", G_CALLBACK(on_latency_commit), NULL);
+        g_signal_connect(terminal, "contents-changed", G_CALLBACK(on_latency_output), NULL);
+        g_signal_connect_after(terminal, "draw", G_CALLBACK(on_latency_draw), NULL);
+    }
+    print_line(LEVEL_TRACE,"Configure terminal");
+    apply_terminal_settings(terminal);
+    g_object_set_data_full(G_OBJECT(terminal), "working_dir", g_strdup(dir), g_free);
+    g_object_set_data_full(G_OBJECT(terminal), "command", g_strdup(cmd), g_free);
+    gtk_widget_show(terminal);
+    if (profile_mode != PROFILE_OFF && !profile_has_mark("create_terminal")) {
+        g_signal_connect_after(terminal, "draw", G_CALLBACK(on_profile_draw), NULL);
+        profile_mark("create_terminal");
+    }
+    return terminal;
+}
+
+/*!
+ * Spawn the shell (or the command) of a terminal created by new_terminal.
+ *
+ * \param terminal
+ */
+static void spawn_terminal(GtkWidget *terminal) {
+    char *dir = g_object_get_data(G_OBJECT(terminal), "working_dir");
+    char *cmd = g_object_get_data(G_OBJECT(terminal), "command");
+    gchar **envp = g_get_environ();
+    gchar *command[] = { g_strdup(g_environ_getenv(envp, "SHELL")), NULL, NULL, NULL };
+    print_line(LEVEL_INFO,"Shell: %s", command[0]);
+    if (cmd != NULL) {
+        command[1] = "-c";
+        command[2] = cmd;
+        print_line(LEVEL_TRACE, "Execute command: %s %s %s", command[0], command[1], command[2]);
+    }
+    g_strfreev(envp);
+    print_line(LEVEL_TRACE, "Set workdir: %s", dir);
+    print_line(LEVEL_TRACE,"Spawn terminal (async)");
+    /* terminal, pty, work_dir, argv, env, spawn, setup fun, setup data, setup data destroy, timeout, cancellable, callback, callback data */
+    vte_terminal_spawn_async(VTE_TERMINAL(terminal),VTE_PTY_DEFAULT, dir, command, NULL, G_SPAWN_DEFAULT, NULL, NULL, NULL, -1, NULL, terminal_callback, NULL);
+    g_free(command[0]);
+}
+
+/*!
+ * Idle callback, spawn one pooled terminal per call until the pool is full.
+ *
+ * \param user_data
+ * \return G_SOURCE_CONTINUE while the pool is not full
+ */
+static gboolean refill_terminal_pool(gpointer user_data) {
+    UNUSED(user_data);
+    if (g_queue_get_length(terminal_pool) >= (guint)pool_size) {
+        pool_refill_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+    print_line(LEVEL_TRACE,"Spawn pooled terminal %d/%d", g_queue_get_length(terminal_pool) + 1, pool_size);
+    GtkWidget *terminal = new_terminal(pool_dir, NULL);
+    spawn_terminal(terminal);
+    gtk_box_pack_start(GTK_BOX(pool_box), terminal, TRUE, TRUE, 0);
+    g_queue_push_tail(terminal_pool, terminal);
+    return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * Schedule the pool refill at idle priority.
+ * The pooled terminals live in a hidden offscreen window so the shell is
+ * already spawned when new_tab or split take one. Only plain shells are
+ * pooled, in the working directory of the first terminal, so a command
+ * given with -e never runs before it is asked for.
+ */
+static void fill_terminal_pool() {
+    if (pool_size <= 0 || pool_refill_id != 0 || term_command != NULL) return;
+    if (terminal_pool == NULL) {
+        print_line(LEVEL_INFO,"Create terminal pool of %d", pool_size);
+        if (working_dir == NULL) working_dir = g_get_current_dir();
+        pool_dir = g_strdup(working_dir);
+        terminal_pool = g_queue_new();
+        GtkWidget *pool_window = gtk_offscreen_window_new();
+        pool_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+        gtk_container_add(GTK_CONTAINER(pool_window), pool_box);
+        gtk_widget_show_all(pool_window);
+    }
+    pool_refill_id = g_idle_add_full(G_PRIORITY_LOW, refill_terminal_pool, NULL, NULL);
+}
+
+/*!
+ * Take a terminal from the pool or create a new one when the pool is empty,
+ * or when a command or another directory is requested. The pool is left
+ * untouched in that case, it keeps serving the plain shells.
+ *
+ * \return terminal (GtkWidget), the caller owns a reference
+ */
+static GtkWidget* take_terminal() {
+    GtkWidget *terminal = NULL;
+    if (term_command == NULL && terminal_pool != NULL && !g_queue_is_empty(terminal_pool) &&
+            (working_dir == NULL || g_strcmp0(working_dir, pool_dir) == 0)) {
+        print_line(LEVEL_TRACE,"Take terminal from pool");
+        terminal = g_object_ref(g_queue_pop_head(terminal_pool));
+        gtk_container_remove(GTK_CONTAINER(pool_box), terminal);
+    } else {
+        terminal = g_object_ref_sink(create_terminal());
+    }
+    fill_terminal_pool();
+    return terminal;
+}
+
+/*!
+ * Show or hide command prompt
+ */
+static void show_hide_commander() {
+    if (gtk_widget_is_visible(commander)) {
+        print_line(LEVEL_INFO,"Hide commander");
+        gtk_entry_set_text(GTK_ENTRY(commander),"");
+        gtk_widget_set_sensitive(commander,FALSE);
+        gtk_widget_hide(commander);
+    } else {
+        print_line(LEVEL_INFO,"Show commander");
+        gtk_widget_show(commander);
+        gtk_widget_set_sensitive(commander,TRUE);
+        gtk_widget_grab_focus(commander);
+    }
+}
+
+/*!
+ * Handle window focus, the focused window becomes the current one.
+ *
+ * \param win
+ * \param event
+ * \param user_data
+ * \return FALSE, propagate event
+ */
+static gboolean on_window_focus(GtkWidget *win, GdkEventFocus event, gpointer user_data) {
+    UNUSED(user_data);
+    if (window != win) {
+        print_line(LEVEL_TRACE,"Switch current window");
+        window = win;
+        notebook = g_object_get_data(G_OBJECT(win), "notebook");
+        commander = g_object_get_data(G_OBJECT(win), "commander");
+    }
+    return FALSE;
+}
+
+/*!
+ * Handle window close request.
+ *
+ * \param win
+ * \param event
+ * \param user_data
+ * \return TRUE, window already handled
+ */
+static gboolean on_window_delete(GtkWidget *win, GdkEvent *event, gpointer user_data) {
+    UNUSED(event);
+    UNUSED(user_data);
+    close_window(win);
+    return TRUE;
+}
+
+/*!
+ * Handle window destroy, forget it if it was the current one.
+ *
+ * \param win
+ * \param user_data
+ */
+static void on_window_destroy(GtkWidget *win, gpointer user_data) {
+    UNUSED(user_data);
+    print_line(LEVEL_INFO,"Window destroyed");
+    if (window == win) {
+        window = NULL;
+        notebook = NULL;
+        commander = NULL;
+        current_terminal = NULL;
+    }
+}
+
+/*!
+ * Create a new window with notebook, commander and first tab.
+ * The new window becomes the current one.
+ *
+ * \return window (GtkWidget)
+ */
+static GtkWidget* create_window() {
+    print_line(LEVEL_INFO,"Create window");
+    window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_icon_name(GTK_WINDOW(window), "utilities-terminal");
+    gtk_window_resize(GTK_WINDOW(window), 600, 400);
+    if (term_title == NULL)
+        gtk_window_set_title(GTK_WINDOW(window), "µterm");
+    else
+        gtk_window_set_title(GTK_WINDOW(window), term_title);
+    g_object_set_data_full(G_OBJECT(window), "title", g_strdup(term_title), g_free);
+    print_line(LEVEL_TRACE,"Set window title %s",gtk_window_get_title(GTK_WINDOW(window)));
+    print_line(LEVEL_TRACE,"Setup opacity");
+    gtk_widget_set_visual(window, gdk_screen_get_rgba_visual(gtk_widget_get_screen(window)));
+    gtk_widget_override_background_color(window, GTK_STATE_FLAG_NORMAL, &CLR_GDK(term_background, term_opacity));
+    print_line(LEVEL_TRACE,"Create notebook");
+    notebook = gtk_notebook_new();
+    commander = gtk_entry_new();
+    g_object_set_data(G_OBJECT(window), "notebook", notebook);
+    g_object_set_data(G_OBJECT(window), "commander", commander);
+    gtk_entry_set_placeholder_text(GTK_ENTRY(commander),"Command:");
+    if (tab_position == 0) gtk_notebook_set_tab_pos(GTK_NOTEBOOK(notebook), GTK_POS_BOTTOM);
+    else gtk_notebook_set_tab_pos(GTK_NOTEBOOK(notebook), GTK_POS_TOP);
+    gtk_notebook_set_scrollable(GTK_NOTEBOOK(notebook), TRUE);
+    gtk_notebook_popup_disable(GTK_NOTEBOOK(notebook));
+    gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), FALSE);
+    gtk_notebook_set_show_border(GTK_NOTEBOOK(notebook), FALSE);
+    print_line(LEVEL_TRACE,"Add event to window");
+    g_signal_connect(window, "delete-event", G_CALLBACK(on_window_delete), NULL);
+    g_signal_connect(window, "destroy", G_CALLBACK(on_window_destroy), NULL);
+    g_signal_connect(window, "focus-in-event", G_CALLBACK(on_window_focus), NULL);
+    g_signal_connect(window, "configure-event", G_CALLBACK(on_window_configure), NULL);
+    if (profile_mode != PROFILE_OFF) g_signal_connect(window, "map-event", G_CALLBACK(on_profile_map), NULL);
+    print_line(LEVEL_TRACE,"Add event to notebook");
+    g_signal_connect(notebook, "page-added", G_CALLBACK(on_tab_add), NULL);
+    g_signal_connect(notebook, "switch-page", G_CALLBACK(on_tab_switch), NULL);
+    g_signal_connect(notebook, "page-removed", G_CALLBACK(on_tab_del), NULL);
+    g_signal_connect(commander,"key-press-event", G_CALLBACK(on_command), NULL);
+    g_signal_connect(commander,"changed", G_CALLBACK(on_command_changed), NULL);
+    print_line(LEVEL_TRACE,"Add notebook to window");
+    GtkWidget* box = gtk_box_new(GTK_ORIENTATION_VERTICAL,1);
+    if (commander_position == 0) {
+        gtk_box_pack_start(GTK_BOX(box),notebook,TRUE,TRUE,0);
+        gtk_box_pack_end(GTK_BOX(box),commander,FALSE,TRUE,0);
+    } else {
+        gtk_box_pack_end(GTK_BOX(box),notebook,TRUE,TRUE,0);
+        gtk_box_pack_start(GTK_BOX(box),commander,FALSE,TRUE,0);
+    }
+    gtk_container_add(GTK_CONTAINER(window), box);
+    /* Restore before showing the window, so only the saved current tab is mapped and spawns its shells */
+    gboolean restored = restore_mode && restore_session();
+    restore_mode = FALSE;
+    print_line(LEVEL_TRACE,"Show window and all content");
+    gtk_widget_show_all(window);
+    gtk_widget_hide(commander);
+    profile_mark("create_window");
+    if (restored) return window;
+    print_line(LEVEL_TRACE,"Add first tab to notebook");
+    add_new_tab();
+    profile_mark("add_new_tab");
+    return window;
+}
+
+/*!
+ * Return the current working directory of a terminal, from the shell
+ * reported directory (OSC 7) or the one used to spawn it.
+ *
+ * \param terminal
+ * \return directory, free with g_free
+ */
+static char* get_terminal_directory(GtkWidget *terminal) {
+    const char *uri = vte_terminal_get_current_directory_uri(VTE_TERMINAL(terminal));
+    char *dir = uri != NULL ? g_filename_from_uri(uri, NULL, NULL) : NULL;
+    if (dir == NULL) dir = g_strdup(g_object_get_data(G_OBJECT(terminal), "working_dir"));
+    return dir;
+}
+
+/*!
+ * Append the layout of a widget to the session.
+ * Layout tokens: "t index" for a terminal, "v ratio child1 child2" or
+ * "h ratio child1 child2" for a split, "e" for an empty split side.
+ *
+ * \param widget terminal, paned or NULL
+ * \param layout layout string
+ * \param session
+ * \param group tab group in session
+ * \param count number of terminals saved in the tab
+ */
+static void save_layout(GtkWidget *widget, GString *layout, GKeyFile *session, char *group, int *count) {
+    if (widget != NULL && VTE_IS_TERMINAL(widget)) {
+        char *key = g_strdup_printf("cwd%d", *count);
+        char *dir = get_terminal_directory(widget);
+        if (dir != NULL) g_key_file_set_string(session, group, key, dir);
+        g_free(dir);
+        g_free(key);
+        char *cmd = g_object_get_data(G_OBJECT(widget), "command");
+        /* Transient commands (export pagers) read files that are gone on restore */
+        if (cmd != NULL && g_object_get_data(G_OBJECT(widget), "transient") == NULL) {
+            key = g_strdup_printf("command%d", *count);
+            g_key_file_set_string(session, group, key, cmd);
+            g_free(key);
+        }
+        g_string_append_printf(layout, "t %d ", (*count)++);
+    } else if (widget != NULL && GTK_IS_PANED(widget)) {
+        gboolean horizontal = gtk_orientable_get_orientation(GTK_ORIENTABLE(widget)) == GTK_ORIENTATION_HORIZONTAL;
+        double ratio = get_split_ratio(widget);
+        char value[G_ASCII_DTOSTR_BUF_SIZE];
+        g_string_append_printf(layout, "%c %s ", horizontal ? 'h' : 'v', g_ascii_formatd(value, sizeof(value), "%.3f", ratio));
+        save_layout(gtk_paned_get_child1(GTK_PANED(widget)), layout, session, group, count);
+        save_layout(gtk_paned_get_child2(GTK_PANED(widget)), layout, session, group, count);
+    } else {
+        g_string_append(layout, "e ");
+    }
+}
+
+/*!
+ * Save tabs, splits and terminals of the current window to the session file.
+ * An empty window keeps the previous session.
+ */
+static void save_session() {
+    if (notebook == NULL || gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) < 1) return;
+    print_line(LEVEL_INFO,"Save session");
+    GKeyFile *session = g_key_file_new();
+    int pages = gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook));
+    g_key_file_set_integer(session, "session", "tabs", pages);
+    g_key_file_set_integer(session, "session", "current", gtk_notebook_get_current_page(GTK_NOTEBOOK(notebook)));
+    for (int i = 0; i < pages; i++) {
+        char *group = g_strdup_printf("tab%d", i);
+        GString *layout = g_string_new(NULL);
+        int count = 0;
+        save_layout(gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook), i), layout, session, group, &count);
+        g_key_file_set_string(session, group, "layout", g_strstrip(layout->str));
+        g_string_free(layout, TRUE);
+        g_free(group);
+    }
+    char *file = get_path_to_config_file_name(APP_SESSION_NAME);
+    char *dir = g_path_get_dirname(file);
+    GError *error = NULL;
+    g_mkdir_with_parents(dir, 0700);
+    if (!g_key_file_save_to_file(session, file, &error)) {
+        print_line(LEVEL_ERROR,"Unable to save session %s: %s", file, error->message);
+        g_clear_error(&error);
+    }
+    g_free(dir);
+    g_free(file);
+    g_key_file_free(session);
+}
+
+/*!
+ * Spawn a restored terminal the first time its tab is shown.
+ *
+ * \param terminal
+ * \param user_data
+ */
+static void on_restored_map(GtkWidget *terminal, gpointer user_data) {
+    UNUSED(user_data);
+    g_signal_handlers_disconnect_by_func(terminal, on_restored_map, NULL);
+    print_line(LEVEL_TRACE,"Restored terminal shown, spawn it");
+    spawn_terminal(terminal);
+}
+
+/*!
+ * Apply the saved split ratio on the first real allocation of a restored split.
+ *
+ * \param paned
+ * \param allocation
+ * \param user_data
+ */
+static void on_restored_allocate(GtkWidget *paned, GtkAllocation *allocation, gpointer user_data) {
+    UNUSED(user_data);
+    double *ratio = g_object_get_data(G_OBJECT(paned), "ratio");
+    gboolean horizontal = gtk_orientable_get_orientation(GTK_ORIENTABLE(paned)) == GTK_ORIENTATION_HORIZONTAL;
+    int size = horizontal ? allocation->width : allocation->height;
+    if (ratio == NULL || size <= 1) return;
+    g_signal_handlers_disconnect_by_func(paned, on_restored_allocate, NULL);
+    gtk_paned_set_position(GTK_PANED(paned), (int)(*ratio * size));
+    g_object_set_data(G_OBJECT(paned), "ratio", NULL);
+}
+
+/*!
+ * Build the widgets of a saved layout, see save_layout.
+ * Terminals are created without spawning their shell.
+ *
+ * \param session
+ * \param group tab group in session
+ * \param tokens layout tokens
+ * \param pos current token
+ * \param tab tab of the new terminals, NULL for the tab itself
+ * \return terminal, paned or NULL for an empty or invalid layout
+ */
+static GtkWidget* restore_layout(GKeyFile *session, char *group, char **tokens, int *pos, GtkWidget *tab) {
+    char *token = tokens[*pos];
+    if (token == NULL) return NULL;
+    (*pos)++;
+    if (strcmp(token, "t") == 0 && tokens[*pos] != NULL && tab != NULL) {
+        char *key = g_strconcat("cwd", tokens[*pos], NULL);
+        char *dir = g_key_file_get_string(session, group, key, NULL);
+        g_free(key);
+        key = g_strconcat("command", tokens[*pos], NULL);
+        char *cmd = g_key_file_get_string(session, group, key, NULL);
+        g_free(key);
+        (*pos)++;
+        if (dir == NULL || !g_file_test(dir, G_FILE_TEST_IS_DIR)) {
+            g_free(dir);
+            dir = g_strdup(g_get_home_dir());
+        }
+        GtkWidget *terminal = new_terminal(dir, cmd);
+        g_signal_connect(terminal, "map", G_CALLBACK(on_restored_map), NULL);
+        register_pane(terminal, tab);
+        g_free(dir);
+        g_free(cmd);
+        return terminal;
+    }
+    if ((strcmp(token, "v") == 0 || strcmp(token, "h") == 0) && tokens[*pos] != NULL) {
+        double *ratio = g_new(double, 1);
+        *ratio = CLAMP(g_ascii_strtod(tokens[(*pos)++], NULL), 0.0, 1.0);
+        GtkWidget *paned = new_split(token[0] == 'h' ? GTK_ORIENTATION_HORIZONTAL : GTK_ORIENTATION_VERTICAL);
+        if (tab == NULL) tab = paned;
+        else gtk_paned_set_wide_handle(GTK_PANED(paned), TRUE);
+        GtkWidget *child1 = restore_layout(session, group, tokens, pos, tab);
+        GtkWidget *child2 = restore_layout(session, group, tokens, pos, tab);
+        if (child1 != NULL) gtk_paned_pack1(GTK_PANED(paned), child1, TRUE, TRUE);
+        if (child2 != NULL) gtk_paned_pack2(GTK_PANED(paned), child2, TRUE, TRUE);
+        if (child1 != NULL && child2 != NULL) {
+            g_object_set_data_full(G_OBJECT(paned), "ratio", ratio, g_free);
+            g_signal_connect(paned, "size-allocate", G_CALLBACK(on_restored_allocate), NULL);
+        } else {
+            g_free(ratio);
+        }
+        gtk_widget_show(paned);
+        return paned;
+    }
+    return NULL;
+}
+
+/*!
+ * Restore the saved session in the current window.
+ * Only the shown tab spawns its terminals, the others wait to be shown.
+ *
+ * \return TRUE if at least one tab is restored
+ */
+static gboolean restore_session() {
+    char *file = get_path_to_config_file_name(APP_SESSION_NAME);
+    GKeyFile *session = g_key_file_new();
+    GError *error = NULL;
+    int restored = 0;
+    print_line(LEVEL_INFO,"Restore session %s", file);
+    if (!g_key_file_load_from_file(session, file, G_KEY_FILE_NONE, &error)) {
+        print_line(LEVEL_WARNING,"Unable to load session %s: %s", file, error->message);
+        g_clear_error(&error);
+    } else {
+        int tabs = g_key_file_get_integer(session, "session", "tabs", NULL);
+        restoring_session = TRUE;
+        for (int i = 0; i < tabs; i++) {
+            char *group = g_strdup_printf("tab%d", i);
+            char *layout = g_key_file_get_string(session, group, "layout", NULL);
+            char **tokens = g_strsplit(layout != NULL ? layout : "", " ", -1);
+            int pos = 0;
+            GtkWidget *tab = restore_layout(session, group, tokens, &pos, NULL);
+            if (tab != NULL && !g_queue_is_empty(get_tab_panes(tab))) {
+                GtkWidget *label = new_tab_label(++restored);
+                gtk_notebook_append_page(GTK_NOTEBOOK(notebook), tab, label);
+            } else if (tab != NULL) {
+                print_line(LEVEL_WARNING,"Empty layout for %s, skip it", group);
+                gtk_widget_destroy(tab);
+            }
+            g_strfreev(tokens);
+            g_free(layout);
+            g_free(group);
+        }
+        restoring_session = FALSE;
+        if (restored > 0) {
+            int current = CLAMP(g_key_file_get_integer(session, "session", "current", NULL), 0, restored - 1);
+            gtk_notebook_set_current_page(GTK_NOTEBOOK(notebook), current);
+            focus_tab(gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook), current));
+            print_line(LEVEL_TRACE,"Restored %d tabs", restored);
+        }
+    }
+    g_key_file_free(session);
+    g_free(file);
+    return restored > 0;
+}
+
+/*!
+ * Initialize and start the terminal.
+ *
+ * \return 0 on success
+ */
+static int start_application() {
+    if (server_mode) {
+        if (!start_server()) return 1;
+    } else {
+        create_window();
+    }
+    fill_terminal_pool();
+    check_scrollback_budget();
+    watch_config_files();
+    start_control_socket();
+    start_stats();
+    gtk_main();
+    if (!server_mode) save_session();
+    stop_log_writer();
+    if (latency_mode) {
+        FILE *output = latency_file != NULL ? fopen(latency_file, "w") : stderr;
+        if (output != NULL) {
+            dump_latency(output);
+            if (output != stderr) fclose(output);
+        } else {
+            print_line(LEVEL_ERROR,"Unable to write latency report %s", latency_file);
+        }
+    }
+    if (server != NULL) {
+        g_socket_service_stop(server);
+        g_unlink(socket_path);
+    }
+    stop_control_socket();
+    return 0;
+}
+
+/*!
+ * Return the path of the server socket
+ *
+ * \return socket path
+ */
+static char* get_socket_path() {
+    if (socket_path == NULL)
+        socket_path = g_build_filename(g_get_user_runtime_dir(), APP_SOCKET_NAME, NULL);
+    return socket_path;
+}
+
+/*!
+ * Open a new window or a new tab for a client request.
+ * The request values replace the command line ones only for the new terminal.
+ *
+ * \param request hashtable with client request values
+ * \param tab TRUE for a new tab in current window
+ */
+static void serve_request(GHashTable *request, gboolean tab) {
+    char *saved_dir = working_dir;
+    char *saved_command = term_command;
+    char *saved_title = term_title;
+    working_dir = g_hash_table_lookup(request, "cwd");
+    term_command = g_hash_table_lookup(request, "command");
+    term_title = g_hash_table_lookup(request, "title");
+    if (tab && window != NULL) {
+        print_line(LEVEL_TRACE,"Serve new tab");
+        add_new_tab();
+        gtk_window_present(GTK_WINDOW(window));
+    } else {
+        print_line(LEVEL_TRACE,"Serve new window");
+        create_window();
     }
-    return FALSE;
+    working_dir = saved_dir;
+    term_command = saved_command;
+    term_title = saved_title;
 }
 
-
 /*!
- * Handle change on terminal title and propagate to window
+ * Reply sent or failed, read the next request line or close the connection.
  *
- * \param terminal
- * \param user_data Gtk Window object
- * \return TRUE on title change, not continue
+ * \param source output stream
+ * \param result
+ * \param user_data Reply
  */
-static gboolean on_terminal_title_change(GtkWidget *terminal, gpointer user_data) {
-    GtkWindow *window = user_data;
-    if (term_title == NULL)
-        gtk_window_set_title(window, vte_terminal_get_window_title(VTE_TERMINAL(terminal)) ?: "µterm");
-    else
-        gtk_window_set_title(window, term_title);
-    return TRUE;
+static void on_reply_written(GObject *source, GAsyncResult *result, gpointer user_data) {
+    Reply *reply = user_data;
+    GError *error = NULL;
+    if (g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, NULL, &error)) {
+        g_data_input_stream_read_line_async(reply->in, G_PRIORITY_DEFAULT, NULL, reply->on_line, reply->connection);
+    } else {
+        print_line(LEVEL_WARNING,"Socket write error, close connection: %s", error->message);
+        g_clear_error(&error);
+        g_io_stream_close(G_IO_STREAM(reply->connection), NULL, NULL);
+        g_object_unref(reply->in);
+        g_object_unref(reply->connection);
+    }
+    g_string_free(reply->text, TRUE);
+    g_free(reply);
 }
 
 /*!
- * Handle add tab event
+ * Send the reply of a request line without blocking the main loop, then
+ * read the next line. A client that does not read its replies stops its
+ * own requests, not the windows.
  *
- * \param notebook
- * \param child
- * \param page_num
- * \param user_data
+ * \param connection
+ * \param in request stream of the connection
+ * \param text reply lines, taken
+ * \param on_line read callback of the next request line
  */
-static void on_tab_add(GtkNotebook *notebook, GtkWidget *child, guint page_num, gpointer user_data) {
-    print_line("info","Add tab %d", page_num);
-    gtk_notebook_set_current_page(GTK_NOTEBOOK(notebook), page_num);
-    if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) > 1) {
-        print_line("trace","Show tabs");
-        gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), TRUE);
-    }
-    if (GTK_IS_CONTAINER(child)) {
-        GList *children = g_list_last(gtk_container_get_children(GTK_CONTAINER(child)));
-        if (children != NULL && GTK_IS_WIDGET(children->data) && gtk_widget_get_can_focus(GTK_WIDGET(children->data))) {
-            gtk_widget_grab_focus(children->data);
-        }
-    } else if (gtk_widget_get_can_focus(child)) {
-        //gtk_window_set_focus(GTK_WINDOW(window), child);
-        gtk_widget_grab_focus(child);
+static void send_reply(GSocketConnection *connection, GDataInputStream *in, GString *text, GAsyncReadyCallback on_line) {
+    if (text->len == 0) {
+        g_string_free(text, TRUE);
+        g_data_input_stream_read_line_async(in, G_PRIORITY_DEFAULT, NULL, on_line, connection);
+        return;
     }
+    Reply *reply = g_new0(Reply, 1);
+    reply->connection = connection;
+    reply->in = in;
+    reply->text = text;
+    reply->on_line = on_line;
+    GOutputStream *out = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+    g_output_stream_write_all_async(out, text->str, text->len, G_PRIORITY_DEFAULT, NULL, on_reply_written, reply);
 }
 
 /*!
- * Handle delete tab event
+ * Async read of a client request line.
+ * Lines are "cwd <dir>", "title <title>", "command <cmd>" and the
+ * final "window" or "tab" that opens the terminal and replies "ok".
  *
- * \param notebook
- * \param child
- * \param page_num
- * \param user_data
+ * \param source data input stream
+ * \param result
+ * \param user_data client connection
  */
-static void on_tab_del(GtkNotebook *notebook, GtkWidget *child, guint page_num, gpointer user_data) {
-    print_line("info","Remove tab %d", page_num);
-    gtk_widget_queue_draw(GTK_WIDGET(notebook));
-    if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) == 1) {
-        if (gtk_notebook_get_show_tabs(GTK_NOTEBOOK(notebook))) {
-            print_line("trace","Hide tabs");
-            gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), FALSE);
-            gtk_widget_queue_draw(GTK_WIDGET(notebook));
-            GtkWidget* active_page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook),0);
-            GtkWidget *label = gtk_label_new("1");
-            gtk_notebook_set_tab_label(GTK_NOTEBOOK(notebook), active_page, label);
+static void on_client_line(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GSocketConnection *connection = user_data;
+    GHashTable *request = g_object_get_data(G_OBJECT(connection), "request");
+    GError *error = NULL;
+    char *line = g_data_input_stream_read_line_finish(G_DATA_INPUT_STREAM(source), result, NULL, &error);
+    if (line == NULL) {
+        if (error != NULL) {
+            print_line(LEVEL_WARNING,"Client read error: %s", error->message);
+            g_clear_error(&error);
         }
-    } else if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) == 1) {
-        print_line("info","Removed last page, quit");
-        gtk_main_quit();
+        g_object_unref(source);
+        g_object_unref(connection);
+        return;
+    }
+    print_line(LEVEL_TRACE,"Client request: %s", line);
+    GString *reply = g_string_new(NULL);
+    char *value = strchr(line, ' ');
+    if (value != NULL) *value++ = 0;
+    if (strcmp(line, "window") == 0 || strcmp(line, "tab") == 0) {
+        serve_request(request, strcmp(line, "tab") == 0);
+        g_string_append(reply, "ok\n");
+        g_hash_table_remove_all(request);
+    } else if (value != NULL) {
+        g_hash_table_replace(request, g_strdup(line), g_strdup(value));
     } else {
-        print_line("trace","Show tabs");
-        gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), TRUE);
-        gtk_widget_queue_draw(GTK_WIDGET(notebook));
-        if (gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) == page_num) {
-            print_line("trace", "removed last page nothing to do");
-        } else {
-            int pi;
-            for (pi=page_num;pi<gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook));pi++) {
-                GtkWidget *label = gtk_label_new(g_strdup_printf("%d", pi+1));
-                gtk_notebook_set_tab_label(GTK_NOTEBOOK(notebook), gtk_notebook_get_nth_page(GTK_NOTEBOOK(notebook),pi), label);
-            }
-        }
+        print_line(LEVEL_ERROR,"Invalid client request");
     }
+    g_free(line);
+    send_reply(connection, G_DATA_INPUT_STREAM(source), reply, on_client_line);
 }
 
 /*!
- * Set the terminal font to specified size.
+ * Handle incoming client connection
  *
- * \param terminal
- * \param font_size
+ * \param service
+ * \param connection
+ * \param source_object
+ * \param user_data
+ * \return TRUE, connection handled
  */
-static void set_terminal_font(GtkWidget *terminal, int font_size) {
-    print_line("info","Alter font to size: %d", font_size);
-    gchar *font_str = g_strconcat(term_font, " ",g_strdup_printf("%d", font_size), NULL);
-    if ((font_desc = pango_font_description_from_string(font_str)) != NULL) {
-        vte_terminal_set_font(VTE_TERMINAL(terminal), font_desc);
-        current_font_size = font_size;
-        pango_font_description_free(font_desc);
-        g_free(font_str);
-    }
+static gboolean on_client_connect(GSocketService *service, GSocketConnection *connection, GObject *source_object, gpointer user_data) {
+    UNUSED(service);
+    UNUSED(source_object);
+    UNUSED(user_data);
+    print_line(LEVEL_INFO,"Client connected");
+    g_object_ref(connection);
+    g_object_set_data_full(G_OBJECT(connection), "request", g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free), (GDestroyNotify)g_hash_table_unref);
+    GDataInputStream *in = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+    g_data_input_stream_read_line_async(in, G_PRIORITY_DEFAULT, NULL, on_client_line, connection);
+    return TRUE;
 }
 
 /*!
- * Update the terminal color palette.
+ * Listen on a unix socket, fail if another process already answers on it.
  *
- * \param terminal
+ * \param path socket path
+ * \param on_connect "incoming" signal handler
+ * \return socket service or NULL on error
  */
-static void set_terminal_colors(GtkWidget *terminal) {
-    print_line("info","Set terminal colors");
-    for (int i = color_count; i < 256; i++) {
-        if (i < 16) {
-            term_palette[i].blue = (((i & 4) ? 0xc000 : 0) + (i > 7 ? 0x3fff : 0)) / 65535.0;
-            term_palette[i].green = (((i & 2) ? 0xc000 : 0) + (i > 7 ? 0x3fff : 0)) / 65535.0;
-            term_palette[i].red = (((i & 1) ? 0xc000 : 0) + (i > 7 ? 0x3fff : 0)) / 65535.0;
-            term_palette[i].alpha = 0;
-        } else if (i < 232) {
-            const unsigned j = i - 16;
-            const unsigned r = j / 36, g = (j / 6) % 6, b = j % 6;
-            term_palette[i].red = ((r == 0) ? 0 : r * 40 + 55) / 255.0;
-            term_palette[i].green = ((g == 0) ? 0 : g * 40 + 55) / 255.0;
-            term_palette[i].blue = ((b == 0) ? 0 : b * 40 + 55) / 255.0;
-            term_palette[i].alpha = 0;
-        } else if (i < 256) {
-            const unsigned shade = 8 + (i - 232) * 10;
-            term_palette[i].red = term_palette[i].green =
-                term_palette[i].blue = (shade | shade << 8) / 65535.0;
-            term_palette[i].alpha = 0;
-        }
+static GSocketService* listen_on_socket(char *path, GCallback on_connect) {
+    GSocketClient *client = g_socket_client_new();
+    GSocketAddress *address = g_unix_socket_address_new(path);
+    GSocketConnection *connection = g_socket_client_connect(client, G_SOCKET_CONNECTABLE(address), NULL, NULL);
+    g_object_unref(client);
+    if (connection != NULL) {
+        print_line(LEVEL_ERROR,"Socket %s already in use", path);
+        g_object_unref(connection);
+        g_object_unref(address);
+        return NULL;
     }
-    /* terminal, foreground, background, palette */
-    vte_terminal_set_colors(VTE_TERMINAL(terminal), &CLR_GDK(term_foreground, 0), &CLR_GDK(term_background, term_opacity), term_palette, sizeof(term_palette) / sizeof(GdkRGBA));
-    vte_terminal_set_color_bold(VTE_TERMINAL(terminal), &CLR_GDK(term_bold_color, 0));
+    /* Remove stale socket left by a crashed process */
+    g_unlink(path);
+    GError *error = NULL;
+    GSocketService *service = g_socket_service_new();
+    if (!g_socket_listener_add_address(G_SOCKET_LISTENER(service), address, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &error)) {
+        print_line(LEVEL_SEVERE,"Unable to listen on %s: %s", path, error->message);
+        g_clear_error(&error);
+        g_object_unref(address);
+        g_object_unref(service);
+        return NULL;
+    }
+    g_object_unref(address);
+    g_signal_connect(service, "incoming", on_connect, NULL);
+    g_socket_service_start(service);
+    return service;
 }
 
 /*!
- * Apply terminal settings.
+ * Start listening on the server socket.
  *
- * \param terminal
+ * \return TRUE on success
  */
-static void apply_terminal_settings(GtkWidget *terminal) {
-    setlocale(LC_NUMERIC, term_locale);
-    vte_terminal_set_mouse_autohide(VTE_TERMINAL(terminal), TRUE);
-    vte_terminal_set_scroll_on_output(VTE_TERMINAL(terminal), FALSE);
-    vte_terminal_set_scroll_on_keystroke(VTE_TERMINAL(terminal), TRUE);
-    vte_terminal_set_scrollback_lines(VTE_TERMINAL(terminal), -1);
-    vte_terminal_set_rewrap_on_resize(VTE_TERMINAL(terminal), TRUE);
-    vte_terminal_set_audible_bell(VTE_TERMINAL(terminal), FALSE);
-    vte_terminal_set_allow_bold(VTE_TERMINAL(terminal), TRUE);
-    vte_terminal_set_allow_hyperlink(VTE_TERMINAL(terminal), TRUE);
-    vte_terminal_set_word_char_exceptions(VTE_TERMINAL(terminal),term_word_chars);
-    vte_terminal_set_cursor_blink_mode(VTE_TERMINAL(terminal), VTE_CURSOR_BLINK_OFF);
-    vte_terminal_set_color_cursor(VTE_TERMINAL(terminal), &CLR_GDK(term_cursor_color, 0));
-    vte_terminal_set_color_cursor_foreground(VTE_TERMINAL(terminal), &CLR_GDK(term_cursor_foreground, 0));
-    vte_terminal_set_cursor_shape(VTE_TERMINAL(terminal), term_cursor_shape);
-    set_terminal_colors(terminal);
-    set_terminal_font(terminal, default_font_size);
+static gboolean start_server() {
+    get_socket_path();
+    print_line(LEVEL_INFO,"Start server on %s", socket_path);
+    server = listen_on_socket(socket_path, G_CALLBACK(on_client_connect));
+    return server != NULL;
 }
 
 /*!
- * Async terminal callback.
+ * Freeze or thaw the updates of all windows, changes made while frozen
+ * are painted once on thaw.
  *
- * \param terminal
- * \param pid (Process ID)
- * \param error
- * \param user_data
+ * \param frozen TRUE to freeze
  */
-static void terminal_callback(VteTerminal *terminal, GPid pid, GError *error, gpointer user_data) {
-    if (error == NULL) {
-        print_line("info","µterm successfully started. (PID: %d)", pid);
-    } else {
-        print_line("severe","Error starting terminal: %s", error->message);
-        g_clear_error(&error);
+static void set_windows_frozen(gboolean frozen) {
+    GList *toplevels = gtk_window_list_toplevels();
+    for (GList *item = toplevels; item != NULL; item = item->next) {
+        if (g_object_get_data(G_OBJECT(item->data), "notebook") == NULL || gtk_widget_get_window(item->data) == NULL) continue;
+        if (frozen) gdk_window_freeze_updates(gtk_widget_get_window(item->data));
+        else gdk_window_thaw_updates(gtk_widget_get_window(item->data));
     }
-    UNUSED(user_data);
-    UNUSED(terminal);
+    g_list_free(toplevels);
 }
 
-
 /*!
- * Add a new tab to notebook
+ * Run one control command and write its reply line,
+ * "ok <function>" or "error <function>: <reason>".
+ *
+ * \param line function string, as in the command prompt
+ * \param reply reply lines
  */
-static void add_new_tab() {
-    print_line("info","Add new tab");
-    GtkWidget *new_term = create_terminal();
-    GtkWidget *box = gtk_paned_new(GTK_ORIENTATION_VERTICAL);
-    gtk_widget_show(new_term);
-    gtk_widget_show(box);
-    gtk_paned_pack1(GTK_PANED(box), new_term, TRUE, TRUE);
-    GtkWidget *label = gtk_label_new(g_strdup_printf("%d", gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook)) + 1));
-    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), box, label);
-    if (gtk_widget_get_can_focus(new_term)) {
-        gtk_widget_grab_focus(new_term);
-        current_terminal = new_term;
-    }
+static void run_control_command(char *line, GString *reply) {
+    print_line(LEVEL_TRACE,"Control command: %s", line);
+    if (current_terminal == NULL || window == NULL)
+        g_string_append_printf(reply, "error %s: no terminal\n", line);
+    else if (get_function(line) == 0)
+        g_string_append_printf(reply, "error %s: invalid function\n", line);
+    else if (!execute_function(line))
+        g_string_append_printf(reply, "error %s: failed\n", line);
+    else
+        g_string_append_printf(reply, "ok %s\n", line);
 }
 
 /*!
- * Add terminal next to another terminal
+ * Async read of a control command line.
+ * Every line is a function string, as in the command prompt, and gets one
+ * reply line. Lines between "batch" and "end" are run together in one
+ * main loop iteration with window updates frozen, then "end <ok>/<total>"
+ * closes the batch replies.
  *
- * \param vertical (true or false for horizontal)
+ * \param source data input stream
+ * \param result
+ * \param user_data control connection
  */
-static void add_terminal_next_to(gboolean vertical) {
-    print_line("info","Add terminal next to current");
-    GtkWidget *parent = gtk_widget_get_parent(current_terminal);
-    GtkWidget *new_term = create_terminal();
-    GtkWidget *box;
-    print_line("trace","Current page: %d",gtk_notebook_get_current_page(GTK_NOTEBOOK(notebook)));
-    if (vertical) {
-        print_line("trace","Create vertical container");
-        box = gtk_paned_new(GTK_ORIENTATION_VERTICAL);
-    } else {
-        print_line("trace","Create horizontal container");
-        box = gtk_paned_new(GTK_ORIENTATION_HORIZONTAL);
+static void on_control_line(GObject *source, GAsyncResult *result, gpointer user_data) {
+    GSocketConnection *connection = user_data;
+    GPtrArray *batch = g_object_get_data(G_OBJECT(connection), "batch");
+    GError *error = NULL;
+    char *line = g_data_input_stream_read_line_finish(G_DATA_INPUT_STREAM(source), result, NULL, &error);
+    if (line == NULL) {
+        if (error != NULL) {
+            print_line(LEVEL_WARNING,"Control read error: %s", error->message);
+            g_clear_error(&error);
+        }
+        g_object_unref(source);
+        g_object_unref(connection);
+        return;
     }
-    GList *children = gtk_container_get_children(GTK_CONTAINER(parent));
-    print_line("trace","Parent size: %d",g_list_length(children));
-    g_object_ref(current_terminal);
-    if (GTK_IS_NOTEBOOK(parent)) {
-        print_line("trace","Remove terminal from notebook");
-        gtk_container_remove(GTK_CONTAINER(parent), current_terminal);
-        print_line("trace", "Add the box to notebook");
-        gtk_container_add(GTK_CONTAINER(parent), box);
-    } else if (GTK_IS_PANED(parent)) {
-        int i;
-        for (i = 0; i < g_list_length(children); i++) {
-            GList *record = g_list_nth(children,i);
-            if (GTK_IS_WIDGET(record->data)) {
-                GtkWidget *child = GTK_WIDGET(record->data);
-                if (child == current_terminal) {
-                    print_line("trace", "Found at %d",i);
-                    break;
-                }
-            }
+    g_strstrip(line);
+    GString *reply = g_string_new(NULL);
+    if (strcmp(line, "batch") == 0) {
+        if (batch == NULL) {
+            batch = g_ptr_array_new_with_free_func(g_free);
+            g_object_set_data_full(G_OBJECT(connection), "batch", batch, (GDestroyNotify)g_ptr_array_unref);
         }
-        print_line("trace","Child position: %d",i);
-        gtk_container_remove (GTK_CONTAINER(parent), current_terminal);
-        if (i == 0) {
-            print_line("trace","Box at start");
-            gtk_paned_pack1(GTK_PANED(parent), box, TRUE, TRUE);
-        } else {
-            print_line("trace","Box at end");
-            gtk_paned_pack2(GTK_PANED(parent), box, TRUE, TRUE);
+    } else if (strcmp(line, "end") == 0 && batch != NULL) {
+        guint ok = 0;
+        print_line(LEVEL_INFO,"Run control batch of %u commands", batch->len);
+        set_windows_frozen(TRUE);
+        for (guint i = 0; i < batch->len; i++) {
+            gsize length = reply->len;
+            run_control_command(g_ptr_array_index(batch, i), reply);
+            if (g_str_has_prefix(reply->str + length, "ok ")) ok++;
         }
-    } else {
-        print_line("error","Unexpected");
+        set_windows_frozen(FALSE);
+        g_string_append_printf(reply, "end %u/%u\n", ok, batch->len);
+        g_object_set_data(G_OBJECT(connection), "batch", NULL);
+    } else if (batch != NULL) {
+        if (!is_empty(line)) g_ptr_array_add(batch, g_strdup(line));
+    } else if (!is_empty(line)) {
+        run_control_command(line, reply);
     }
-    gtk_paned_set_wide_handle (GTK_PANED(box),TRUE);
-    print_line("trace","Add old terminal");
-    gtk_paned_pack1(GTK_PANED(box), current_terminal, TRUE, TRUE);
-    g_object_unref(current_terminal);
-    print_line("trace","Add new_terminal at end");
-    gtk_paned_pack2(GTK_PANED(box), new_term, TRUE, TRUE);
-    gtk_widget_show_all(box);
-    print_line("trace","Set focus to new terminal");
-    gtk_widget_grab_focus(new_term);
-    current_terminal = new_term;
+    g_free(line);
+    send_reply(connection, G_DATA_INPUT_STREAM(source), reply, on_control_line);
 }
 
 /*!
- * Create a new terminal widget.
+ * Handle incoming control connection
  *
- * \return terminal (GtkWidget)
+ * \param service
+ * \param connection
+ * \param source_object
+ * \param user_data
+ * \return TRUE, connection handled
  */
-static GtkWidget* create_terminal() {
-    print_line("info","Create new terminal");
-    GtkWidget *terminal = vte_terminal_new();
-    print_line("trace","Connect signals to terminal");
-    g_signal_connect(terminal, "child-exited", G_CALLBACK(on_terminal_exit), NULL);
-    g_signal_connect(terminal, "key-press-event", G_CALLBACK(on_hotkey), NULL);
-    g_signal_connect(terminal, "window-title-changed", G_CALLBACK(on_terminal_title_change), GTK_WINDOW(window));
-    g_signal_connect(terminal, "selection-changed", G_CALLBACK(on_terminal_selection), NULL);
-    g_signal_connect(terminal, "focus-in-event", G_CALLBACK(has_focus), NULL);
-    g_signal_connect(terminal, "motion-notify-event",G_CALLBACK(focus_change),NULL);
-    print_line("trace","Configure terminal");
-    apply_terminal_settings(terminal);
-    envp = g_get_environ();
-    command = (gchar *[]){g_strdup(g_environ_getenv(envp, "SHELL")), NULL};
-    print_line("info","Shell: %s", command[0]);
-    if (term_command != NULL) {
-        command = (gchar *[]){g_strdup(g_environ_getenv(envp, "SHELL")), "-c", term_command, NULL};
-        print_line("trace", "Execute command: %s %s %s", command[0], command[1], command[2]);
-    }
-    g_strfreev(envp);
-    if (working_dir == NULL) {
-        print_line("trace", "Set default working_dir: %s", g_get_current_dir());
-        working_dir = g_get_current_dir();
-    }
-    print_line("trace", "Set workdir: %s", working_dir);
-    print_line("trace","Spawn terminal (async)");
-    /* terminal, pty, work_dir, argv, env, spawn, setup fun, setup data, setup data destroy, timeout, cancellable, callback, callback data */
-    vte_terminal_spawn_async(VTE_TERMINAL(terminal),VTE_PTY_DEFAULT, working_dir, command, NULL, G_SPAWN_DEFAULT, NULL, NULL, NULL, -1, NULL, terminal_callback, NULL);
-    gtk_widget_show(terminal);
-    return terminal;
+static gboolean on_control_connect(GSocketService *service, GSocketConnection *connection, GObject *source_object, gpointer user_data) {
+    UNUSED(service);
+    UNUSED(source_object);
+    UNUSED(user_data);
+    print_line(LEVEL_INFO,"Control client connected");
+    g_object_ref(connection);
+    GDataInputStream *in = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+    g_data_input_stream_read_line_async(in, G_PRIORITY_DEFAULT, NULL, on_control_line, connection);
+    return TRUE;
 }
 
 /*!
- * Show or hide command prompt
+ * Start the control socket when control_socket is set.
+ * A relative path is created inside $XDG_RUNTIME_DIR.
  */
-static void show_hide_commander() {
-    if (gtk_widget_is_visible(commander)) {
-        print_line("info","Hide commander");
-        gtk_entry_set_text(GTK_ENTRY(commander),"");
-        gtk_widget_set_sensitive(commander,FALSE);
-        gtk_widget_hide(commander);
-    } else {
-        print_line("info","Show commander");
-        gtk_widget_show(commander);
-        gtk_widget_set_sensitive(commander,TRUE);
-        gtk_widget_grab_focus(commander);
-    }
+static void start_control_socket() {
+    if (control_socket == NULL || control_server != NULL) return;
+    if (g_path_is_absolute(control_socket)) control_path = g_strdup(control_socket);
+    else control_path = g_build_filename(g_get_user_runtime_dir(), control_socket, NULL);
+    print_line(LEVEL_INFO,"Start control socket on %s", control_path);
+    control_server = listen_on_socket(control_path, G_CALLBACK(on_control_connect));
+    if (control_server == NULL) g_clear_pointer(&control_path, g_free);
 }
 
 /*!
- * Initialize and start the terminal.
+ * Stop the control socket, the connected clients are still served.
+ */
+static void stop_control_socket() {
+    if (control_server == NULL) return;
+    print_line(LEVEL_INFO,"Stop control socket on %s", control_path);
+    g_socket_service_stop(control_server);
+    g_socket_listener_close(G_SOCKET_LISTENER(control_server));
+    g_clear_object(&control_server);
+    g_unlink(control_path);
+    g_clear_pointer(&control_path, g_free);
+}
+
+/*!
+ * Ask a running server to open the terminal.
  *
- * \return 0 on success
+ * \return TRUE if the server opened the terminal
  */
-static int start_application() {
-    print_line("info","Create window");
-    window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
-    gtk_window_set_icon_name(GTK_WINDOW(window), "utilities-terminal");
-    gtk_window_resize(GTK_WINDOW(window), 600, 400);
-    if (term_title == NULL)
-        gtk_window_set_title(GTK_WINDOW(window), "µterm");
-    else
-        gtk_window_set_title(GTK_WINDOW(window), term_title);
-    print_line("trace","Set window title %s",gtk_window_get_title(GTK_WINDOW(window)));
-    print_line("trace","Setup opacity");
-    gtk_widget_set_visual(window, gdk_screen_get_rgba_visual(gtk_widget_get_screen(window)));
-    gtk_widget_override_background_color(window, GTK_STATE_FLAG_NORMAL, &CLR_GDK(term_background, term_opacity));
-    print_line("trace","Create notebook");
-    notebook = gtk_notebook_new();
-    commander = gtk_entry_new();
-    gtk_entry_set_placeholder_text(GTK_ENTRY(commander),"Command:");
-    if (tab_position == 0) gtk_notebook_set_tab_pos(GTK_NOTEBOOK(notebook), GTK_POS_BOTTOM);
-    else gtk_notebook_set_tab_pos(GTK_NOTEBOOK(notebook), GTK_POS_TOP);
-    gtk_notebook_set_scrollable(GTK_NOTEBOOK(notebook), TRUE);
-    gtk_notebook_popup_disable(GTK_NOTEBOOK(notebook));
-    gtk_notebook_set_show_tabs(GTK_NOTEBOOK(notebook), FALSE);
-    gtk_notebook_set_show_border(GTK_NOTEBOOK(notebook), FALSE);
-    print_line("trace","Add event to window");
-    g_signal_connect(window, "delete-event", gtk_main_quit, NULL);
-    print_line("trace","Add event to notebook");
-    g_signal_connect(notebook, "page-added", G_CALLBACK(on_tab_add), NULL);
-    g_signal_connect(notebook, "page-removed", G_CALLBACK(on_tab_del), NULL);
-    g_signal_connect(commander,"key-press-event", G_CALLBACK(on_command), NULL);
-    print_line("trace","Add notebook to window");
-    GtkWidget* box = gtk_box_new(GTK_ORIENTATION_VERTICAL,1);
-    if (commander_position == 0) {
-        gtk_box_pack_start(GTK_BOX(box),notebook,TRUE,TRUE,0);
-        gtk_box_pack_end(GTK_BOX(box),commander,FALSE,TRUE,0);
-    } else {
-        gtk_box_pack_end(GTK_BOX(box),notebook,TRUE,TRUE,0);
-        gtk_box_pack_start(GTK_BOX(box),commander,FALSE,TRUE,0);
+static gboolean run_client() {
+    GSocketClient *client = g_socket_client_new();
+    GSocketAddress *address = g_unix_socket_address_new(get_socket_path());
+    GSocketConnection *connection = g_socket_client_connect(client, G_SOCKET_CONNECTABLE(address), NULL, NULL);
+    g_object_unref(address);
+    g_object_unref(client);
+    if (connection == NULL) {
+        print_line(LEVEL_TRACE,"No server running, start standalone");
+        return FALSE;
     }
-    gtk_container_add(GTK_CONTAINER(window), box);
-    print_line("trace","Show window and all content");
-    gtk_widget_show_all(window);
-    gtk_widget_hide(commander);
-    print_line("trace","Add first tab to notebook");
-    add_new_tab();
-    gtk_main();
-    return 0;
+    print_line(LEVEL_INFO,"Send request to server");
+    char *cwd = working_dir != NULL ? g_strdup(working_dir) : g_get_current_dir();
+    GString *request = g_string_new(NULL);
+    g_string_append_printf(request, "cwd %s\n", cwd);
+    if (term_title != NULL) g_string_append_printf(request, "title %s\n", term_title);
+    if (term_command != NULL) g_string_append_printf(request, "command %s\n", term_command);
+    g_string_append(request, open_in_tab ? "tab\n" : "window\n");
+    g_free(cwd);
+    gboolean served = FALSE;
+    GOutputStream *out = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+    if (g_output_stream_write_all(out, request->str, request->len, NULL, NULL, NULL)) {
+        GDataInputStream *in = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+        char *reply = g_data_input_stream_read_line(in, NULL, NULL, NULL);
+        served = (reply != NULL && strcmp(reply, "ok") == 0);
+        print_line(LEVEL_TRACE,"Server reply: %s", reply);
+        g_free(reply);
+        g_object_unref(in);
+    }
+    g_string_free(request, TRUE);
+    g_io_stream_close(G_IO_STREAM(connection), NULL, NULL);
+    g_object_unref(connection);
+    return served;
 }
 
 /*!
@@ -773,11 +4240,8 @@ static int start_application() {
  * \return color
  */
 static int parse_color(char *value) {
-    if (value[0] == '#') {
-        memmove(value, value + 1, strlen(value));
-        sprintf(value, "%s", g_strconcat("0x", value, NULL));
-    }
-    return (int)strtol(value, NULL, 16);
+    /* strtol accepts the optional 0x prefix with base 16 */
+    return (int)strtol(value[0] == '#' ? value + 1 : value, NULL, 16);
 }
 
 /*!
@@ -811,33 +4275,42 @@ static gboolean is_empty(char *s) {
 
 /*!
  * Read and apply settings from configuration file.
+ *
+ * \param input_file
+ * \return FALSE if the file or an included one can't be read
  */
-static void parse_settings(char *input_file) {
-    print_line("info","Prse config file");
+static gboolean parse_settings(char *input_file) {
+    print_line(LEVEL_INFO,"Prse config file");
     char buf[TERM_CONFIG_LENGTH],
         option[TERM_CONFIG_LENGTH],
         value[TERM_CONFIG_LENGTH],
         data[TERM_CONFIG_LENGTH];
+    gboolean parsed = TRUE;
     if (input_file == NULL) {
-        print_line("error","Invalid file name");
-    } else {
-        print_line("trace","Parse file %s", input_file);
+        print_line(LEVEL_ERROR,"Invalid file name");
+        return FALSE;
     }
+    print_line(LEVEL_TRACE,"Parse file %s", input_file);
+    if (config_files == NULL) config_files = g_ptr_array_new_with_free_func(g_free);
+    if (!g_ptr_array_find_with_equal_func(config_files, input_file, g_str_equal, NULL))
+        g_ptr_array_add(config_files, g_strdup(input_file));
     FILE *config_file = fopen(input_file, "r");
     if (config_file == NULL) {
-        print_line("warning","Config file not found. (%s)", input_file);
-        return;
+        print_line(LEVEL_WARNING,"Config file not found. (%s)", input_file);
+        return FALSE;
     }
     while (fgets(buf, TERM_CONFIG_LENGTH, config_file)) {
         // Skip empty lines or lines that starting with '#'
         if (is_empty(buf) || buf[0] == '#')
             continue;
         sscanf(buf, "%s %s %[^\n]\n", option, value, data);
-        print_line("trace", "Set option %s -> %s (%s)", option, value, data);
+        print_line(LEVEL_TRACE, "Set option %s -> %s (%s)", option, value, data);
         if (!strncmp(option, "locale", strlen(option))) {
-            term_locale = g_strdup(value);
+            g_free(locale_value);
+            term_locale = locale_value = g_strdup(value);
         } else if (!strncmp(option, "char", strlen(option))) {
             // Remove '"'
+            g_free(word_chars);
             word_chars = g_strdup(value);
             word_chars[strlen(word_chars) - 1] = 0;
             term_word_chars = word_chars + 1;
@@ -856,8 +4329,11 @@ static void parse_settings(char *input_file) {
             if (font_size != NULL) {
                 default_font_size = atoi(font_size + 1);
                 *font_size = 0;
-                term_font = g_strconcat(value, " ", data, NULL);
+                g_free(font_value);
+                term_font = font_value = g_strconcat(value, " ", data, NULL);
             }
+        } else if (!strncmp(option, "font_zoom", strlen(option))) {
+            zoom_window = (!strncmp(value, "window", strlen(value)));
         } else if (!strncmp(option, "opacity", strlen(option))) {
             term_opacity = atof(value);
         } else if (!strncmp(option, "cursor", strlen(option))) {
@@ -881,8 +4357,39 @@ static void parse_settings(char *input_file) {
             focus_follow_mouse = (!strncmp(value, "true", strlen(value)));
         } else if (!strncmp(option, "copy_on_selection", strlen(option))) {
             copy_on_selection = (!strncmp(value, "true", strlen(value)));
+        } else if (!strncmp(option, "hibernate_after", strlen(option))) {
+            hibernate_after = atoi(value);
+        } else if (!strncmp(option, "log_dir", strlen(option))) {
+            g_free(log_dir);
+            log_dir = g_strdup(value);
+        } else if (!strncmp(option, "log_max_mb", strlen(option))) {
+            log_max_mb = atoi(value);
+        } else if (!strncmp(option, "log_compress", strlen(option))) {
+            log_compress = (!strncmp(value, "true", strlen(value)));
+        } else if (!strncmp(option, "log_all", strlen(option))) {
+            log_all = (!strncmp(value, "true", strlen(value)));
+        } else if (!strncmp(option, "control_socket", strlen(option))) {
+            g_free(control_socket);
+            control_socket = g_strdup(value);
+        } else if (!strncmp(option, "watch_config", strlen(option))) {
+            watch_config = (!strncmp(value, "true", strlen(value)));
+        } else if (!strncmp(option, "rewrap_on_resize", strlen(option))) {
+            rewrap_on_resize = (!strncmp(value, "true", strlen(value)));
+        } else if (!strncmp(option, "scrollback_lines", strlen(option))) {
+            scrollback_lines = atol(value);
+        } else if (!strncmp(option, "scrollback_budget_mb", strlen(option))) {
+            scrollback_budget_mb = atoi(value);
+        } else if (!strncmp(option, "pool_size", strlen(option))) {
+            pool_size = atoi(value);
         } else if (!strncmp(option, "include", strlen(option))) {
-            parse_settings(get_path_to_config_file_name(value));
+            char *include_file = get_path_to_config_file_name(value);
+            parsed = parse_settings(include_file) && parsed;
+            g_free(include_file);
+            if (profile_mode != PROFILE_OFF) {
+                char *phase = g_strconcat("include ", value, NULL);
+                profile_mark(phase);
+                g_free(phase);
+            }
         } else if (!strncmp(option, "color", strlen(option) - 2)) {
             char *color_index = strrchr(option, 'r');
             if (color_index != NULL) {
@@ -892,11 +4399,16 @@ static void parse_settings(char *input_file) {
         } else if (!strncmp(option, "hotkey", strlen(option))) {
             parse_hotkey(value,data);
         } else {
-            print_line("error","Invalid config line");
+            print_line(LEVEL_ERROR,"Invalid config line");
         }
         memset(data, '\0', sizeof(data)); 
     }
+    if (ferror(config_file)) {
+        print_line(LEVEL_ERROR,"Unable to read %s", input_file);
+        parsed = FALSE;
+    }
     fclose(config_file);
+    return parsed;
 }
 
 /*!
@@ -913,6 +4425,7 @@ static int get_function(char* function) {
     else if (strcmp(function,"font_dec") == 0) return FUNCTION_FONT_DEC;
     else if (strcmp(function,"font_inc") == 0) return FUNCTION_FONT_INC;
     else if (strcmp(function,"font_reset") == 0) return FUNCTION_FONT_RESET;
+    else if (strcmp(function,"latency") == 0) return FUNCTION_LATENCY;
     else if (strcmp(function,"new_tab") == 0) return FUNCTION_NEW_TAB;
     else if (strcmp(function,"next") == 0) return FUNCTION_NEXT;
     else if (strcmp(function,"prev") == 0) return FUNCTION_PREV;
@@ -920,18 +4433,117 @@ static int get_function(char* function) {
     else if (strcmp(function,"reload") == 0) return FUNCTION_RELOAD;
     else if (strcmp(function,"split_h") == 0) return FUNCTION_SPLIT_H;
     else if (strcmp(function,"split_v") == 0) return FUNCTION_SPLIT_V;
-    else if (strlen(function) > 4 && strncmp("goto",function,4) == 0) return FUNCTION_GOTO;
-    else if (strlen(function) > 4 && strncmp("exec",function,4) == 0) return FUNCTION_EXEC;
+    else if (strcmp(function,"log") == 0) return FUNCTION_LOG;
+    else if (strcmp(function,"stats") == 0) return FUNCTION_STATS;
+    else if (strncmp("trace ",function,6) == 0) return FUNCTION_TRACE;
+    else if (strcmp(function,"find_next") == 0) return FUNCTION_FIND_NEXT;
+    else if (strcmp(function,"find_prev") == 0) return FUNCTION_FIND_PREV;
+    else if (strncmp("find_all ",function,9) == 0) return FUNCTION_FIND_ALL;
+    else if (strcmp(function,"find") == 0 || strncmp("find ",function,5) == 0) return FUNCTION_FIND;
+    else if (strcmp(function,"export") == 0 || strncmp("export ",function,7) == 0) return FUNCTION_EXPORT;
+    else if (strncmp("goto ",function,5) == 0) return FUNCTION_GOTO;
+    else if (strncmp("exec_tab ",function,9) == 0) return FUNCTION_EXEC_TAB;
+    else if (strncmp("exec_all ",function,9) == 0) return FUNCTION_EXEC_ALL;
+    else if (strncmp("exec ",function,5) == 0) return FUNCTION_EXEC;
+    else if (strcmp(function,"sync_input") == 0 || strncmp("sync_input ",function,11) == 0) return FUNCTION_SYNC_INPUT;
+    else if (strcmp(function,"scrollback") == 0 || strncmp("scrollback ",function,11) == 0) return FUNCTION_SCROLLBACK;
     return 0;
 }
 
 /*!
- * Stores hotkey and function in hotkeys hashtable
+ * Return the hotkey code, key value and modifiers packed in one integer.
+ *
+ * \param keyval
+ * \param state modifiers
+ * \return hotkey code
+ */
+static gint64 get_hotkey_code(guint keyval, guint state) {
+    gint64 modifiers = 0;
+    if (state & GDK_CONTROL_MASK) modifiers |= HOTKEY_CONTROL;
+    if (state & GDK_SHIFT_MASK) modifiers |= HOTKEY_SHIFT;
+    if (state & GDK_MOD1_MASK) modifiers |= HOTKEY_MOD1;
+    if (state & (GDK_SUPER_MASK | GDK_META_MASK)) modifiers |= HOTKEY_META;
+    return (modifiers << 32) | keyval;
+}
+
+/*!
+ * Free a compiled hotkey and its chord.
+ *
+ * \param data Binding
+ */
+static void free_binding(gpointer data) {
+    Binding *binding = data;
+    if (binding->chord != NULL) g_hash_table_unref(binding->chord);
+    g_free(binding->argument);
+    g_free(binding);
+}
+
+/*!
+ * Return a new hotkey table
+ */
+static GHashTable* new_hotkey_table() {
+    return g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, free_binding);
+}
+
+/*!
+ * Compile hotkey and function into hotkeys table.
+ * Chords are comma separated, for example: Control+b,c new_tab
+ * A key that starts a chord can't run a function too, the chord is kept.
  */
 static void parse_hotkey(char* hotkey, char* function) {
-    print_line("info","parse_hotkey");
-    print_line("trace","Hotkey to parse: %s -> %s", hotkey, function);
-    g_hash_table_insert(hotkeys, g_strdup(hotkey),g_strdup(function));
+    print_line(LEVEL_INFO,"parse_hotkey");
+    print_line(LEVEL_TRACE,"Hotkey to parse: %s -> %s", hotkey, function);
+    gchar **keys = g_strsplit(hotkey, ",", -1);
+    GHashTable *table = hotkeys;
+    Binding *binding = NULL;
+    for (int k = 0; keys[k] != NULL; k++) {
+        gchar **parts = g_strsplit(keys[k], "+", -1);
+        guint length = g_strv_length(parts);
+        guint state = 0;
+        for (guint p = 0; p + 1 < length; p++) {
+            if (strcmp(parts[p], "Control") == 0) state |= GDK_CONTROL_MASK;
+            else if (strcmp(parts[p], "Shift") == 0) state |= GDK_SHIFT_MASK;
+            else if (strcmp(parts[p], "Mod1") == 0) state |= GDK_MOD1_MASK;
+            else if (strcmp(parts[p], "Meta") == 0) state |= GDK_META_MASK;
+            else print_line(LEVEL_WARNING,"Invalid modifier %s", parts[p]);
+        }
+        guint keyval = length > 0 ? gdk_keyval_from_name(parts[length - 1]) : GDK_KEY_VoidSymbol;
+        g_strfreev(parts);
+        if (keyval == GDK_KEY_VoidSymbol) {
+            print_line(LEVEL_ERROR,"Invalid key in hotkey %s", hotkey);
+            g_strfreev(keys);
+            return;
+        }
+        if (binding != NULL) {
+            if (binding->chord == NULL) {
+                if (binding->function != 0) {
+                    print_line(LEVEL_WARNING,"Hotkey %s is the prefix of chord %s, its function is ignored", keys[k - 1], hotkey);
+                    binding->function = 0;
+                    g_clear_pointer(&binding->argument, g_free);
+                }
+                binding->chord = new_hotkey_table();
+            }
+            table = binding->chord;
+        }
+        gint64 code = get_hotkey_code(keyval, state);
+        binding = g_hash_table_lookup(table, &code);
+        if (binding == NULL) {
+            gint64 *key = g_new(gint64, 1);
+            *key = code;
+            binding = g_new0(Binding, 1);
+            g_hash_table_insert(table, key, binding);
+        }
+    }
+    g_strfreev(keys);
+    if (binding == NULL) return;
+    if (binding->chord != NULL) {
+        print_line(LEVEL_WARNING,"Hotkey %s is the prefix of a chord, %s is ignored", hotkey, function);
+        return;
+    }
+    g_free(binding->argument);
+    binding->function = get_function(function);
+    binding->argument = g_strdup(get_function_argument(function));
+    if (binding->function == 0) print_line(LEVEL_WARNING,"Invalid function %s", function);
 }
 
 /*!
@@ -943,40 +4555,68 @@ static void parse_hotkey(char* hotkey, char* function) {
  */
 static int parse_params(int argc, char **argv) {
     int opt;
-    while ((opt = getopt(argc, argv, ":c:w:e:t:vdh")) != -1) {
+    static struct option long_options[] = {
+        {"server", no_argument, NULL, OPTION_SERVER},
+        {"tab", no_argument, NULL, OPTION_TAB},
+        {"latency", optional_argument, NULL, OPTION_LATENCY},
+        {"profile-startup", optional_argument, NULL, OPTION_PROFILE_STARTUP},
+        {"restore", no_argument, NULL, OPTION_RESTORE},
+        {NULL, 0, NULL, 0}
+    };
+    while ((opt = getopt_long(argc, argv, ":c:w:e:t:vdh", long_options, NULL)) != -1) {
         switch (opt) {
             case 'c':
                 config_file_name = optarg;
-                print_line("trace","Set configuration file: %s", config_file_name);
-                parse_settings(config_file_name);
+                default_config_file = FALSE;
+                print_line(LEVEL_TRACE,"Set configuration file: %s", config_file_name);
                 break;
             case 'w':
                 working_dir = optarg;
-                print_line("trace","Set working dir: %s", working_dir);
+                print_line(LEVEL_TRACE,"Set working dir: %s", working_dir);
                 break;
             case 'e':
                 term_command = optarg;
-                print_line("trace","Set command: %s", term_command);
+                print_line(LEVEL_TRACE,"Set command: %s", term_command);
                 break;
             case 't':
                 term_title = optarg;
-                print_line("trace","Set title: %s", term_title);
+                print_line(LEVEL_TRACE,"Set title: %s", term_title);
                 break;
             case 'd':
-                print_line("info","Enable debug messages");
+                print_line(LEVEL_INFO,"Enable debug messages");
                 debug_mode = TRUE;
                 break;
+            case OPTION_SERVER:
+                print_line(LEVEL_TRACE,"Run as server");
+                server_mode = TRUE;
+                break;
+            case OPTION_TAB:
+                print_line(LEVEL_TRACE,"Open new tab in server");
+                open_in_tab = TRUE;
+                break;
+            case OPTION_LATENCY:
+                print_line(LEVEL_TRACE,"Enable latency measure");
+                latency_mode = TRUE;
+                latency_file = optarg;
+                break;
+            case OPTION_PROFILE_STARTUP:
+                profile_mode = (optarg != NULL && strcmp(optarg, "json") == 0) ? PROFILE_JSON : PROFILE_TEXT;
+                break;
+            case OPTION_RESTORE:
+                print_line(LEVEL_TRACE,"Restore saved session");
+                restore_mode = TRUE;
+                break;
             case 'v':
                 fprintf(stderr, "%s%sµterm (%s)%s - %s%s\n",TERM_ATTR_BOLD,TERM_ATTR_COLOR,APP_NAME,TERM_ATTR_DEFAULT,APP_RELEASE,TERM_ATTR_OFF);
                 return 1;
             case 'h': 
             case '?':
-                fprintf(stderr,"%s[ %susage%s ] %s [-h] [-v] [-d] [-c config] [-t title] [-w workdir] [-e command]%s\n",
+                fprintf(stderr,"%s[ %susage%s ] %s [-h] [-v] [-d] [-c config] [-t title] [-w workdir] [-e command] [--server] [--tab] [--latency[=file]] [--profile-startup[=json]] [--restore]%s\n",
                     TERM_ATTR_BOLD,TERM_ATTR_COLOR,TERM_ATTR_DEFAULT,APP_NAME,TERM_ATTR_OFF);
                 return 1;
             case ':':
                 debug_mode = TRUE;
-                print_line("error","Invalid argument.");
+                print_line(LEVEL_ERROR,"Invalid argument.");
                 return 1;
         }
     }
@@ -987,13 +4627,21 @@ static int parse_params(int argc, char **argv) {
  * Main method
  */
 int main(int argc, char *argv[]) {
-    hotkeys = g_hash_table_new(g_str_hash,g_str_equal);
+    profile_start = g_get_monotonic_time();
+    /* One write per debug message instead of one per fprintf */
+    setvbuf(stderr, NULL, _IOLBF, 0);
+    start_trace();
+    hotkeys = new_hotkey_table();
     if (parse_params(argc, argv))
         return 0;
-    if (default_config_file) parse_settings(get_default_config_file_name());
-    else parse_settings(config_file_name);
+    profile_mark("parse_params");
+    /* A custom configuration or a session can't be honoured by a running server */
+    if (!server_mode && !restore_mode && config_file_name == NULL && run_client())
+        return 0;
+    load_settings();
+    profile_mark("parse_settings");
     gtk_init(&argc, &argv);
-    print_line("trace","Hotkeys defined: %d",g_hash_table_size(hotkeys));
-    start_application();
-    return 0;
+    profile_mark("gtk_init");
+    print_line(LEVEL_TRACE,"Hotkeys defined: %d",g_hash_table_size(hotkeys));
+    return start_application();
 }
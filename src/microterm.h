@@ -16,6 +16,7 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
 #include <vte/vte.h>
 #define APP_NAME "microterm"
 #define APP_RELEASE "2.3"
@@ -31,7 +32,20 @@
 #define TERM_CURSOR_FG 0xffffff
 #define TERM_PALETTE_SIZE 256
 #define TERM_CONFIG_LENGTH 64
+#define TERM_SCROLLBACK_LINES -1
+#define TERM_SCROLLBACK_CELL_BYTES 8 /* Estimated bytes of an uncompressed scrollback cell: UTF-8 text and attributes, not measured RSS */
+#define TERM_SCROLLBACK_CHECK_INTERVAL 5 /* Seconds between scrollback budget checks */
+#define CONFIG_WATCH_INTERVAL 500 /* Milliseconds between automatic reloads */
+#define STATS_DEBUG_INTERVAL 30 /* Seconds between stats reports with debug messages */
+#define SELECTION_SETTLE_DELAY 200 /* Milliseconds without selection changes before copy on selection extracts the text */
+#define SEARCH_SETTLE_DELAY 150 /* Milliseconds without typing before the incremental search runs */
+#define ZOOM_SETTLE_DELAY 60 /* Milliseconds without zoom keys before the fonts are set, coalesces key repeat */
+#define RESIZE_SETTLE_DELAY 150 /* Milliseconds without size changes before the terminals are rewrapped */
+#define FONT_SIZE_MIN 4
+#define FONT_SIZE_MAX 96
 #define APP_CONFIG_DIR "/.config/"
+#define APP_SOCKET_NAME "microterm.sock"
+#define APP_SESSION_NAME "session"
 #define TERM_ATTR_OFF "\x1b[0m"
 #define TERM_ATTR_BOLD "\x1b[1m"
 #define TERM_ATTR_COLOR "\x1b[34m"
@@ -51,25 +65,296 @@
 #define FUNCTION_PREV 11
 #define FUNCTION_NEXT 12
 #define FUNCTION_CLOSE 13
+#define FUNCTION_LATENCY 14
+#define FUNCTION_SYNC_INPUT 15
+#define FUNCTION_FIND_NEXT 16
+#define FUNCTION_FIND_PREV 17
+#define FUNCTION_LOG 18
+#define FUNCTION_STATS 19
 #define FUNCTION_EXEC 30
+#define FUNCTION_SCROLLBACK 31
+#define FUNCTION_EXEC_TAB 32
+#define FUNCTION_EXEC_ALL 33
+#define FUNCTION_FIND 34
+#define FUNCTION_FIND_ALL 35
+#define FUNCTION_EXPORT 36
+#define FUNCTION_TRACE 37
 #define FUNCTION_GOTO 50
 #define FUNCTION_COMMAND 100
 
+/* Terminals reached by exec and synchronized input */
+#define SCOPE_CURRENT 0
+#define SCOPE_TAB 1
+#define SCOPE_ALL 2
+
+/* Modifiers of a compiled hotkey */
+#define HOTKEY_CONTROL (1 << 0)
+#define HOTKEY_SHIFT (1 << 1)
+#define HOTKEY_MOD1 (1 << 2)
+#define HOTKEY_META (1 << 3)
+
+/* Compiled hotkey, chord prefixes have a table of the following keys */
+typedef struct binding {
+    int function; /* FUNCTION_* value, 0 for chord prefix only */
+    char *argument; /* Function argument (goto, exec, ...) or NULL */
+    GHashTable *chord; /* Next keys of the chord or NULL */
+} Binding;
+
+/* Keystroke latency histogram, fixed size buckets plus overflow */
+#define LATENCY_BUCKETS 1000
+#define LATENCY_BUCKET_USEC 100
+#define LATENCY_MAX_WAIT_USEC 1000000 /* Older key presses are not matched with output */
+
+typedef struct latency_histogram {
+    guint32 buckets[LATENCY_BUCKETS + 1];
+    guint32 count;
+    gint64 max;
+} LatencyHistogram;
+
+/* Per terminal latency, key press to contents-changed and to paint */
+typedef struct latency_stats {
+    gint64 key_time; /* Pending key press or 0 */
+    gint64 output_time; /* Contents changed for pending key press or 0 */
+    gboolean committed; /* Pending key press was sent to the child process */
+    LatencyHistogram output;
+    LatencyHistogram paint;
+} LatencyStats;
+
+/* Render settings resolved once per configuration and shared by all terminals */
+typedef struct render_settings {
+    gint ref_count;
+    GdkRGBA palette[TERM_PALETTE_SIZE];
+    GdkRGBA foreground;
+    GdkRGBA background;
+    GdkRGBA bold;
+    GdkRGBA cursor;
+    GdkRGBA cursor_foreground;
+    int cursor_shape;
+    PangoFontDescription *font; /* Font at default size */
+    GHashTable *fonts; /* Font descriptions of the zoomed sizes, by size */
+    int font_size;
+    char *word_chars;
+    long scrollback_lines;
+    gboolean rewrap_on_resize;
+} RenderSettings;
+
+/* Settings read from configuration, restored when a reload fails */
+typedef struct config_snapshot {
+    float term_opacity;
+    int term_background;
+    int term_foreground;
+    int term_bold_color;
+    int term_cursor_color;
+    int term_cursor_foreground;
+    int term_cursor_shape;
+    int default_font_size;
+    GdkRGBA term_palette[TERM_PALETTE_SIZE];
+    int color_count;
+    int tab_position;
+    int commander_position;
+    gboolean zoom_window;
+    gboolean focus_follow_mouse;
+    gboolean copy_on_selection;
+    gboolean rewrap_on_resize;
+    gboolean watch_config;
+    int log_max_mb;
+    gboolean log_compress;
+    gboolean log_all;
+    int hibernate_after;
+    int pool_size;
+    long scrollback_lines;
+    int scrollback_budget_mb;
+    char *font_value; /* Owned copies of the configuration strings */
+    char *locale_value;
+    char *word_chars;
+    char *log_dir;
+    char *control_socket;
+} ConfigSnapshot;
+
+/* Stats consumers, each measures rates since its own previous report */
+#define STATS_COMMAND 0 /* stats function */
+#define STATS_SIGNAL 1 /* SIGUSR1 */
+#define STATS_TIMER 2 /* Periodic report with debug messages */
+#define STATS_CONSUMERS 3
+
+typedef struct stats_baseline {
+    gint64 time; /* Monotonic time of the previous report */
+    guint wakeups; /* Main loop wakeups at the previous report */
+} StatsBaseline;
+
+/* Registered terminal, the registry gives O(1) lookup by widget and id */
+typedef struct pane {
+    guint id; /* Stable pane id */
+    GtkWidget *terminal;
+    GtkWidget *tab; /* Notebook page that contains the pane */
+    GList mru_link; /* Link in the most recently used panes queue */
+    GList tab_link; /* Link in the tab most recently used panes queue */
+    GtkWidget *split; /* Split that holds the pane, NULL when the pane fills the tab */
+    double split_ratio; /* Split position as fraction of its size, 1 without split */
+    glong stats_row[STATS_CONSUMERS]; /* Cursor row at the previous stats report of each consumer */
+    gint64 stats_time[STATS_CONSUMERS]; /* Monotonic time of the previous stats report of each consumer */
+} Pane;
+
+/* Startup profiler */
+#define PROFILE_OFF 0
+#define PROFILE_TEXT 1
+#define PROFILE_JSON 2
+#define PROFILE_MAX_MARKS 32
+
+typedef struct profile_mark {
+    char *name; /* Phase completed */
+    gint64 time; /* Monotonic time at phase end */
+} ProfileMark;
+
+/* Clipboard text written to the pty in chunks as the program reads it */
+#define PASTE_CHUNK_SIZE 4096 /* Most bytes written each time the pty is writable */
+#define PASTE_PROGRESS_SIZE 65536 /* Pastes from this size show their progress */
+
+typedef struct paste {
+    GtkWidget *terminal; /* Destination terminal */
+    char *text; /* Text to paste, converted and bracketed */
+    gsize length;
+    gsize offset; /* Bytes already pasted */
+    guint source_id; /* Pty writable watch */
+    gboolean progress; /* Progress shown on the command prompt */
+} Paste;
+
+/* Search across the scrollback of all panes */
+typedef struct search {
+    VteRegex *regex;
+    char *pattern;
+    GList *ids; /* Panes still to search, most recently used first */
+    GString *found; /* Ids of the panes with a match */
+    guint first; /* Most recently used pane with a match, 0 none */
+    guint source_id; /* Idle source that searches the next pane */
+} Search;
+
+/* Terminal contents read in chunks by the main thread and exported by a worker thread */
+#define EXPORT_CHUNK_ROWS 2000 /* Rows read per main loop iteration */
+
+typedef struct export {
+    char *path; /* Destination file, gzip compressed if it ends with .gz */
+    char *command; /* Command that reads the file in a new tab, NULL for none */
+    GtkWidget *terminal; /* Terminal being read, NULL when closed */
+    glong row; /* Next row to read */
+    glong end_row; /* Last row at the start of the export */
+    GString *text; /* Rows read so far */
+    GBytes *contents; /* Serialized terminal contents */
+} Export;
+
+/* Pane output log, filled by the main thread and written by the writer thread */
+#define LOG_RING_SIZE (1 << 20) /* Bytes buffered per pane, power of two */
+#define LOG_FLUSH_INTERVAL 200000 /* Microseconds between writer thread flushes */
+#define LOG_ROTATE_KEEP 5 /* Rotated logs kept per pane */
+
+typedef struct logger {
+    char *path; /* Log file */
+    char *ring; /* Ring buffer of LOG_RING_SIZE bytes */
+    gint head; /* Bytes appended, written by the main thread only */
+    gint tail; /* Bytes flushed, written by the writer thread only */
+    gint dropped; /* Bytes lost because the ring was full */
+    gint closing; /* Set by the main thread, the writer flushes and frees */
+    glong row; /* Next terminal row to log, main thread */
+    gsize max_size; /* Rotation size, 0 never rotate */
+    gboolean compress; /* Compress rotated logs */
+    FILE *file; /* Writer thread */
+    gboolean failed; /* Log file could not be opened, reported once, writer thread */
+    gsize size; /* Current file size, writer thread */
+} Logger;
+
+/* Socket reply written asynchronously, the next request line is read once it is sent */
+typedef struct reply {
+    GSocketConnection *connection;
+    GDataInputStream *in; /* Request stream of the connection */
+    GString *text; /* Reply lines */
+    GAsyncReadyCallback on_line; /* Read callback of the next request line */
+} Reply;
+
+/* Trace levels, print_line calls above TRACE_LEVEL are removed at compile time */
+#define LEVEL_SEVERE 0
+#define LEVEL_ERROR 1
+#define LEVEL_WARNING 2
+#define LEVEL_INFO 3
+#define LEVEL_TRACE 4
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL LEVEL_TRACE
+#endif
+#define print_line(level, ...) do { if ((level) <= TRACE_LEVEL) trace_event((level), __VA_ARGS__); } while (0)
+
+/* Trace ring, the last events are kept in memory and dumped on demand */
+#define TRACE_RING_SIZE 4096 /* Events, power of two */
+#define TRACE_PAYLOAD_SIZE 104 /* Argument bytes per event */
+#define TRACE_SPEC_SIZE 32
+#define TRACE_LINE_SIZE 1024
+
+typedef struct trace_event {
+    gint64 time; /* Monotonic time */
+    const char *format; /* print_line format, a string literal */
+    guint8 level; /* LEVEL_* value */
+    guint8 size; /* Payload bytes used */
+    char payload[TRACE_PAYLOAD_SIZE]; /* Arguments, 8 bytes each, strings copied with their terminator */
+} TraceEvent;
+
+/* Long only command line options */
+#define OPTION_SERVER 256
+#define OPTION_TAB 257
+#define OPTION_LATENCY 258
+#define OPTION_PROFILE_STARTUP 259
+#define OPTION_RESTORE 260
+
+static int trace_event(int level, const char *format, ...) G_GNUC_PRINTF(2, 3);
+static GtkWidget* create_window();
 static void add_new_tab();
+static void add_tab(GtkWidget *new_term);
 static void add_terminal_next_to(gboolean vertical);
 static GtkWidget* create_terminal();
-static void parse_settings(char *input_file);
+static GtkWidget* new_terminal(char *dir, char *cmd);
+static void spawn_terminal(GtkWidget *terminal);
+static gboolean cancel_paste(GtkWidget *terminal);
+static GtkWidget* take_terminal();
+static void fill_terminal_pool();
+static gboolean parse_settings(char *input_file);
+static gboolean load_settings();
+static GHashTable* new_hotkey_table();
 static void apply_terminal_settings(GtkWidget *terminal);
+static RenderSettings* get_render_settings();
+static void render_settings_unref(RenderSettings *settings);
+static void invalidate_render_settings();
+static void update_terminal_settings(GtkWidget *terminal, RenderSettings *settings);
+static gboolean reload_settings();
+static void watch_config_files();
+static void remove_source(gpointer source_id);
+static void save_session();
+static char* get_terminal_directory(GtkWidget *terminal);
+static gboolean restore_session();
 static void set_terminal_font(GtkWidget *term, int fontSize);
+static PangoFontDescription* get_font_description(RenderSettings *settings, int font_size);
+static void zoom_font(int step, gboolean reset);
 static char* get_default_config_file_name();
+static char* get_path_to_config_file_name(char *file_name);
+static gboolean is_empty(char *s);
 
 static int get_function(char* function);
+static char* get_function_argument(char* function);
 static void parse_hotkey(char* hotkey, char* function);
+static gint64 get_hotkey_code(guint keyval, guint state);
 static void show_hide_commander();
 static gboolean execute_function(char* function);
+static gboolean run_function(int function, char* argument);
 static gboolean on_command(GtkWidget* commander, GdkEventKey* event, gpointer user_data);
 
-static gboolean go_to(char* page_str);
-static gboolean send_command_to_terminal(char* function);
+static gboolean go_to(char* argument);
+static gboolean set_scrollback(char* argument);
+static GList* get_all_terminals();
+static Pane* get_pane(GtkWidget *terminal);
+static void show_message(char *format, ...);
+static gboolean send_command_to_terminal(char* argument, int scope);
 static gboolean has_focus(GtkWidget* terminal, GdkEventFocus event, gpointer user_data);
 static gboolean focus_change(GtkWidget* terminal, GdkEventMotion event, gpointer user_data);
+
+static void profile_mark(char *name);
+static gboolean toggle_log(GtkWidget *terminal);
+static gboolean start_server();
+static void start_control_socket();
+static void stop_control_socket();
+static gboolean run_client();
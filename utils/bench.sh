@@ -0,0 +1,84 @@
+#!/bin/bash
+# Output throughput benchmark for microterm.
+# Runs fixed workloads with -e under Xvfb and prints one JSON line per run
+# with wall time to drain the output, CPU time and peak RSS.
+#
+# Usage: bench.sh [-d] [path/to/microterm]
+# Environment: BENCH_SIZE_MB (default 16), BENCH_RUNS (default 3)
+
+binary="./build/microterm"
+debug=0
+size_mb="${BENCH_SIZE_MB:-16}"
+runs="${BENCH_RUNS:-3}"
+
+if [[ "${1}" == "-d" ]]; then
+  debug=1
+  shift
+fi
+[[ ! -z "${1}" ]] && binary="${1}"
+
+if [[ ! -x "${binary}" ]]; then
+  echo "Usage ${0} [-d] <microterm binary>"
+  exit 1
+fi
+
+if [[ ! -x /usr/bin/time ]]; then
+  echo "GNU time (/usr/bin/time) is required"
+  exit 1
+fi
+
+# Run headless when there is no display
+if [[ -z "${DISPLAY}" ]]; then
+  if ! command -v xvfb-run > /dev/null; then
+    echo "DISPLAY is not set and xvfb-run is not available"
+    exit 1
+  fi
+  [[ ${debug} == 1 ]] && echo "[BENCH] Restart under xvfb-run" >&2
+  exec xvfb-run -a -s "-screen 0 1280x800x24" "${0}" $([[ ${debug} == 1 ]] && echo "-d") "${binary}"
+fi
+
+work_dir=$(mktemp -d)
+trap 'rm -rf "${work_dir}"' EXIT
+
+# Workloads
+function make_workloads() {
+  local bytes=$((size_mb * 1024 * 1024))
+  [[ ${debug} == 1 ]] && echo "[BENCH] Generate ${size_mb} MB workloads in ${work_dir}" >&2
+  base64 -w 120 /dev/urandom | head -c ${bytes} > "${work_dir}/ascii"
+  awk -v bytes=${bytes} 'BEGIN { while (n < bytes) { line = ""; for (i = 0; i < 16; i++) line = line sprintf("\033[38;5;%dm\033[48;5;%dmcolour ", (n + i) % 256, (n + i * 7) % 256); line = line "\033[0m"; print line; n += length(line) + 1 } }' > "${work_dir}/sgr"
+  awk -v bytes=${bytes} 'BEGIN { while (n < bytes) { print "漢字かなカナ한국어全角文字テスト漢字かなカナ한국어全角文字テスト"; n += 91 } }' > "${work_dir}/cjk"
+  awk -v bytes=${bytes} 'BEGIN { while (n < bytes) { print i++; n += length(i) + 1 } }' > "${work_dir}/scroll"
+}
+
+# Configuration variants
+function make_configs() {
+  printf "scrollback_lines -1\nrewrap_on_resize true\n" > "${work_dir}/unlimited.conf"
+  printf "scrollback_lines 10000\nrewrap_on_resize true\n" > "${work_dir}/bounded.conf"
+  printf "scrollback_lines -1\nrewrap_on_resize false\n" > "${work_dir}/norewrap.conf"
+}
+
+# Run one workload, print the JSON result line
+function run() {
+  local workload="${1}"
+  local config="${2}"
+  local run="${3}"
+  local command="true"
+  [[ "${workload}" != "startup" ]] && command="cat ${work_dir}/${workload}"
+  [[ ${debug} == 1 ]] && echo "[BENCH] ${workload} with ${config} (run ${run})" >&2
+  /usr/bin/time -o "${work_dir}/time" -f "%e %U %S %M" "${binary}" -c "${work_dir}/${config}.conf" -e "${command}" > /dev/null 2>&1
+  read wall user sys rss < "${work_dir}/time"
+  echo "{\"workload\":\"${workload}\",\"config\":\"${config}\",\"run\":${run},\"size_mb\":${size_mb},\"wall_s\":${wall},\"user_s\":${user},\"sys_s\":${sys},\"max_rss_kb\":${rss}}"
+}
+
+make_workloads
+make_configs
+
+for config in unlimited bounded norewrap; do
+  for run in $(seq 1 ${runs}); do
+    # Startup only, subtract it from the workloads to get the drain time
+    run startup ${config} ${run}
+    for workload in ascii sgr cjk scroll; do
+      run ${workload} ${config} ${run}
+    done
+  done
+done
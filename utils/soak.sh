@@ -0,0 +1,159 @@
+#!/bin/bash
+# Memory soak test for microterm.
+# Runs microterm under Xvfb, types synthetic keys and repeats tab, split,
+# close and reload cycles through the control socket, then fails when the
+# resident memory grows after the warm-up or when the leak checker reports
+# memory errors or leaks of microterm that grow with the cycles.
+#
+# Usage: soak.sh [-d] [path/to/microterm]
+# Environment: SOAK_TOOL (asan or valgrind, default asan), SOAK_KEYS (default 1000000),
+#              SOAK_CYCLES (default 200), SOAK_MAX_GROWTH_KB (default 16384)
+
+binary="./build/microterm-soak"
+debug=0
+tool="${SOAK_TOOL:-asan}"
+keys="${SOAK_KEYS:-1000000}"
+cycles="${SOAK_CYCLES:-200}"
+max_growth_kb="${SOAK_MAX_GROWTH_KB:-16384}"
+
+if [[ "${1}" == "-d" ]]; then
+  debug=1
+  shift
+fi
+[[ ! -z "${1}" ]] && binary="${1}"
+
+if [[ ! -x "${binary}" ]]; then
+  echo "Usage ${0} [-d] <microterm binary>"
+  exit 1
+fi
+
+for required in xdotool socat; do
+  if ! command -v ${required} > /dev/null; then
+    echo "${required} is required"
+    exit 1
+  fi
+done
+
+if [[ "${tool}" == "valgrind" ]] && ! command -v valgrind > /dev/null; then
+  echo "valgrind is required with SOAK_TOOL=valgrind"
+  exit 1
+fi
+
+# Run headless when there is no display
+if [[ -z "${DISPLAY}" ]]; then
+  if ! command -v xvfb-run > /dev/null; then
+    echo "DISPLAY is not set and xvfb-run is not available"
+    exit 1
+  fi
+  [[ ${debug} == 1 ]] && echo "[SOAK] Restart under xvfb-run" >&2
+  exec xvfb-run -a -s "-screen 0 1280x800x24" "${0}" $([[ ${debug} == 1 ]] && echo "-d") "${binary}"
+fi
+
+work_dir=$(mktemp -d)
+socket="${work_dir}/control.sock"
+pid=0
+trap '[[ ${pid} -gt 0 ]] && kill ${pid} 2> /dev/null; rm -rf "${work_dir}"' EXIT
+
+printf "control_socket %s\nscrollback_lines 1000\npool_size 0\n" "${socket}" > "${work_dir}/soak.conf"
+
+# Send functions to the control socket, fail on error replies
+function control() {
+  local reply
+  reply=$(printf "%s\n" "$@" | socat -t 10 - UNIX-CONNECT:"${socket}")
+  [[ ${debug} == 1 ]] && echo "[SOAK] ${reply//$'\n'/, }" >&2
+  if [[ "${reply}" == *"error "* ]]; then
+    echo "Control function failed: ${reply}"
+    exit 1
+  fi
+}
+
+# Resident memory of microterm in KiB
+function rss() {
+  awk '/^VmRSS:/ { print $2 }' /proc/${pid}/status
+}
+
+# Type keys into the focused terminal, 10 keys each "echo soak" line
+function type_keys() {
+  local count="${1}"
+  local line
+  line=$(printf 'echo soak\n%.0s' $(seq 1 100))
+  while [[ ${count} -gt 0 ]]; do
+    xdotool type --delay 0 "${line}"
+    count=$((count - 1000))
+  done
+}
+
+export G_SLICE=always-malloc
+export G_DEBUG=gc-friendly
+export ASAN_OPTIONS="detect_leaks=1:quarantine_size_mb=16:malloc_context_size=30:exitcode=0"
+command=("${binary}")
+[[ "${tool}" == "valgrind" ]] && command=(valgrind --leak-check=full --show-leak-kinds=definite "${binary}")
+
+[[ ${debug} == 1 ]] && echo "[SOAK] Start ${command[*]}" >&2
+"${command[@]}" -c "${work_dir}/soak.conf" > /dev/null 2> "${work_dir}/log" &
+pid=$!
+
+for wait in $(seq 1 600); do
+  [[ -S "${socket}" ]] && break
+  sleep 0.1
+done
+if [[ ! -S "${socket}" ]]; then
+  echo "Control socket not available"
+  exit 1
+fi
+
+window=$(xdotool search --sync --pid ${pid} | head -n 1)
+xdotool windowfocus --sync ${window}
+
+keys_per_cycle=$((keys / cycles))
+warmup=$((cycles / 10 + 1))
+start_rss=0
+for cycle in $(seq 1 ${cycles}); do
+  type_keys ${keys_per_cycle}
+  # The shells of the new tab exit, the splits are removed up to the tab
+  control new_tab split_h split_v "exec_tab exit"
+  sleep 0.5
+  control new_tab close reload
+  xdotool windowfocus --sync ${window}
+  if [[ ${cycle} == ${warmup} ]]; then
+    start_rss=$(rss)
+    [[ ${debug} == 1 ]] && echo "[SOAK] RSS after warm-up ${start_rss} KiB" >&2
+  fi
+done
+end_rss=$(rss)
+
+control quit
+wait ${pid}
+pid=0
+
+growth=$((end_rss - start_rss))
+echo "{\"tool\":\"${tool}\",\"keys\":${keys},\"cycles\":${cycles},\"start_rss_kb\":${start_rss},\"end_rss_kb\":${end_rss},\"growth_kb\":${growth}}"
+
+result=0
+if grep -q "ERROR: AddressSanitizer\|Invalid read\|Invalid write\|Invalid free" "${work_dir}/log"; then
+  echo "Memory errors:"
+  cat "${work_dir}/log"
+  result=1
+fi
+
+# Leaks of microterm allocated at least once per cycle, one-time allocations of GTK are ignored
+awk -v cycles=${cycles} '
+  /Direct leak of .* in [0-9]+ object/ { flush(); count = $(NF - 3); record = $0; next }
+  /definitely lost in loss record/ { flush(); count = $5; gsub(/,/, "", count); record = $0; next }
+  record != "" && /^[=0-9 ]*$|^$/ { flush(); next }
+  record != "" { record = record "\n" $0; if ($0 ~ /microterm\.c/) own = 1 }
+  function flush() { if (record != "" && own && count + 0 >= cycles) { print record; found = 1 } record = ""; own = 0 }
+  END { flush(); exit found }
+' "${work_dir}/log" > "${work_dir}/leaks"
+if [[ $? != 0 ]]; then
+  echo "Leaks growing with the cycles:"
+  cat "${work_dir}/leaks"
+  result=1
+fi
+
+if [[ ${growth} -gt ${max_growth_kb} ]]; then
+  echo "RSS grew ${growth} KiB after warm-up (max ${max_growth_kb} KiB)"
+  result=1
+fi
+
+exit ${result}